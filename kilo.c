@@ -7,6 +7,13 @@ d
 */
 
 #pragma region /*** Packages ***/
+//feature test macros tried to get getline working always throwing a fit
+//(they have to come before the first include or they do nothing)
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE >= 500
+
 //Terminal Package
 #include <termios.h>
 
@@ -14,12 +21,6 @@ d
 #include <unistd.h>
 #include <stdlib.h>
 
-//feature test macros tried to get getline working always throwing a fit
-#define _DEFAULT_SOURCE
-#define _BSD_SOURCE
-#define _GNU_SOURCE
-#define _XOPEN_SOURCE >= 500
-
 //Writing/IO Packages
 #include <ctype.h>
 #include <stdio.h>
@@ -40,12 +41,47 @@ d
 #include <time.h>
 #include <stdarg.h>
 
+//For Regex Replace
+#include <regex.h>
+
+//For the ASCII fast path
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+
+//For Grep Mode
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//For kilo --server/--client
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+
+//For follow mode
+#include <sys/inotify.h>
+
+//For .gz files
+#include <zlib.h>
+
 #pragma endregion
 
 #pragma region /*** Definitions ***/
 #define KILO_VERSION "0.0.1"
 #define KILO_TAB_STOP 8
 #define KILO_QUIT_TIMES 3
+#define KILO_RX_STEP 64 //chars between cx->rx checkpoints
+#define KILO_ROW_INLINE 8 //rows shorter than this keep their text inside the erow
+#define ARENA_CLASSES 44 //16..128 by 16, then 4 steps per doubling up to ARENA_MAX_BLOCK
+#define ARENA_MAX_BLOCK 65536 //bigger blocks come straight from malloc
+#define ARENA_CHUNK (1 << 20) //slab blocks are carved out of 1MB chunks
+#define PROF_BUCKETS 40 //log2 ns buckets, the last one takes everything past ~9 minutes
 
 
 #define CTRL_KEY(k) ((k) & 0x1f) //Strips bits 5, 6
@@ -61,7 +97,8 @@ enum editorKey //enumurate special keys
 	PAGE_DOWN,
 	HOME_KEY,
 	END_KEY,
-	DELETE_KEY
+	DELETE_KEY,
+	DISK_CHANGED //not a key, editorReadKey hands it out while idle when the file changed under us
 };
 
 enum editorHighlight //string class coloring
@@ -79,6 +116,17 @@ enum editorHighlight //string class coloring
 #define HL_HIGHLIGHT_NUMBERS (1<<0) //bit flag num hl
 #define HL_HIGHLIGHT_STRINGS (1<<1) //bit flag string hl
 
+enum editorUndoType //primitive edits the undo log knows how to reverse
+{
+	UNDO_INSERT_CHAR,
+	UNDO_DELETE_CHAR,
+	UNDO_INSERT_ROW,
+	UNDO_DELETE_ROW,
+	UNDO_APPEND_STRING,
+	UNDO_TRUNCATE_ROW,
+	UNDO_SET_ROW //whole row swapped out (replace)
+};
+
 #pragma endregion
 
 #pragma region /*** Data  ***/
@@ -93,25 +141,302 @@ struct editorSyntax {
 	int flags; //bit field turn on and off diff hl
 };
 
-typedef struct erow //stores editor row data
+struct arenaChunk //slab memory, blocks are bump allocated from data
 {
-	//rendered 'visible' vars
-	int rsize;
-	char *render;
+	struct arenaChunk *next;
+	size_t used;
+	char data[];
+};
+
+struct arenaLarge //header in front of blocks too big for a size class
+{
+	struct arenaLarge *prev, *next;
+	size_t size;
+};
+
+struct editorArena //owns every row's chars/render/hl/checkpoints (and undo text) of a buffer
+{
+	struct arenaChunk *chunks;
+	void *freelist[ARENA_CLASSES]; //freed blocks, linked through their first word
+	struct arenaLarge *large;
+
+	//counters
+	long allocs, frees;
+	long blocks; //live blocks
+	size_t inuse; //bytes in live blocks
+	size_t reserved; //bytes taken from malloc (chunks + large)
+	size_t mallocequiv; //what malloc would hold for the same live blocks
+};
+
+typedef struct hlspan //a run of render[off..off+len) in one color, gaps between spans are HL_NORMAL
+{
+	int off;
+	unsigned short len; //long runs are split
+	unsigned char hl;
+} hlspan;
+
+typedef struct erowcp //where a char sits in chars, on screen and in render
+{
+	int cx, rx, ri;
+} erowcp;
+
+struct erowcps //position checkpoints about every KILO_RX_STEP chars in order, rxcp[0] = row start. an arena block of its own, only rows >= KILO_RX_STEP have one
+{
+	int rxcpcap;
+	int ncp; //valid checkpoints
+	struct erowcp rxcp[];
+};
 
+typedef struct erow //stores editor row data, the text itself lives in E.arena (or inline). its render and colors are E.rowdraw[] at the same index
+{
 	//internal rep
+	char *chars; //points at u.inl for short rows
 	int size;
-	char *chars;
-
-	//Styling vars
-	unsigned char *hl;
+	int cap; //allocated size of chars, grows by doubling. 0 = inline
+	int utf8at; //first byte >= 0x80, -1 if the row is pure ASCII
 
 	//ML Commenting
-	int idx;
-	int hl_open_comment;
+	unsigned int ver : 30; //bumped on every re-render, the highlight worker checks it before publishing
+	unsigned int hl_open_comment : 1;
+	unsigned int hl_stale : 1; //waiting for the worker
 
+	union //short rows never need checkpoints, so their text sits where the checkpoint pointer would
+	{
+		struct erowcps *cp; //cap != 0, NULL until the row gets long enough
+		char inl[KILO_ROW_INLINE]; //cap == 0
+	} u;
 } erow;
 
+typedef struct erowdraw //what editorDrawRows and the highlighter read of a row, dense in E.rowdraw so a screenful is a few cache lines
+{
+	char *render; //same pointer as chars when there's nothing to expand (no tabs)
+	hlspan *hl; //colored runs in render order
+	int rsize;
+	int nhl; //spans in hl
+	int rcap; //allocated size of render, 0 = shares chars
+	int hlcap; //allocated size of hl in bytes
+} erowdraw;
+
+typedef struct editorUndoOp //one reversible edit
+{
+	int type;
+	int group; //ops sharing a group are undone together
+	int row, col; //where the edit happened
+	int c; //char for single char deletes
+	int len; //bytes inserted/removed
+	char *text; //removed text, owned by the op (NULL if none)
+	int cap; //allocated size of text in the arena
+} editorUndoOp;
+
+typedef struct grepMatch //one hit from grep mode
+{
+	char *path;
+	int line; //0 based row in the file
+	int col; //byte offset of match in the line
+	char *text; //line text (truncated)
+	int len;
+} grepMatch;
+
+struct editorReplay //--replay: keys come from a script in memory, every key and frame gets measured
+{
+	const char *keys; //NULL = reading the terminal
+	size_t len, pos;
+	const char *path;
+	int pending; //continuation bytes of a utf-8 char still to come, they belong to the same key
+	int started; //a key is being timed
+	struct timespec t0; //when it was read
+	long *ns; //per key time, from reading it to asking for the next one
+	int nkeys, keycap;
+	int *bytes; //per frame bytes sent to the terminal
+	int nframes, framecap;
+};
+
+struct editorStream //kilo -: a reader thread fills ring from the pipe, the idle loop turns it into rows
+{
+	int fd; //what stdin was, -1 = not streaming
+	int buf; //buffer the rows go to, -1 once the pipe is drained and closed
+	pthread_t reader;
+	pthread_mutex_t lock; //ring indexes and eof, the bytes themselves belong to whoever is past them
+	pthread_cond_t room; //ring drained, the reader can go on
+	char *ring;
+	size_t cap, head, tail; //running byte counts, consumed and produced
+	int eof; //read returned 0 or failed, errno in err
+	int err;
+	int wake[2]; //readable while the ring has bytes, the idle poll watches it next to the terminal
+};
+
+struct editorGzipJob //a .gz save being compressed and written off the main thread
+{
+	int active; //started and not picked up yet
+	int buf; //buffer it's for
+	char *path, *data; //path with links resolved, the rename lands on the file itself
+	int len;
+	int dirty; //the buffer's edits the save covers, taken off once it lands
+	mode_t mode; //the file's permissions, or the umask's for a new one
+	uint64_t *hash; //the rows' hashes as saved, the buffer's reload base once it lands
+	int lines;
+	pthread_t writer;
+	pthread_mutex_t lock; //done and the results
+	int done, err; //err = errno of whatever failed, 0 = written
+	size_t outlen;
+	struct stat st; //the file as written
+};
+
+typedef struct editorFold //rows start+1..end are hidden behind row start
+{
+	int start, end;
+} editorFold;
+
+typedef struct brsum //(), [] and {} of a run of rows outside strings and comments, once the pairs inside it cancel
+{
+	int open[3]; //left open at its end
+	int close[3]; //closing something before it, they all come ahead of the opens
+} brsum;
+
+struct editorBrackets //a buffer's bracket index, built the first time a match is looked for
+{
+	brsum *tree; //segment tree, tree[1] sums every row, leaves from tree[size] on
+	int size; //leaves, a power of 2. 0 = not built
+	int gap; //rows before it have leaf = row, the rest sit the size - numrows empty leaves further right
+	int from, to; //leaves whose nodes are stale, from > to = none
+};
+
+struct editorFolds //a buffer's closed folds (Ctrl-K, Ctrl-U)
+{
+	editorFold *all; //every closed fold by start, ones inside others too. rows count from the start of its top, end < 0 = deleted
+	int n, cap;
+	int ntop, topcap; //tops: the outermost ones, overlaps merged. what is actually hidden
+	int *first; //top i's folds are all[first[i]..first[i + 1])
+	int *gap; //top i's start - top i - 1's (row 0's for the first)
+	int *len; //rows top i hides, 0 = deleted, it stays until the next editorFoldIndex
+	int *gtree, *ltree; //fenwick trees over gap (sum = a start) and over the len of the top before (sum = rows hidden above)
+	int shown_from, shown_end; //rows hidden or shown since the wrap lines were counted
+};
+
+enum memTag //who a tracked heap block belongs to
+{
+	MEM_ROWS, //the E.row and E.rowdraw arrays
+	MEM_UNDO, //undo op array (op text lives in the arena)
+	MEM_HLWORK, //highlight worker snapshots
+	MEM_ABUF, //frames being built
+	MEM_SEARCH, //prompt input, replace scratch
+	MEM_GREP, //grep results
+	MEM_SCREEN, //compositor cell grids
+	MEM_DISKHASH, //line hashes of each buffer's file as last read or written
+	MEM_STREAM, //kilo - ring buffer
+	MEM_WRAP, //soft wrap line counts and their index
+	MEM_FOLD, //closed folds
+	MEM_BRACKET, //bracket index
+	MEM_TAGS
+};
+
+struct memStat
+{
+	long cur, peak; //bytes
+	long allocs; //times it grew
+};
+
+struct profHist //latency histogram
+{
+	long count, sum, max; //ns
+	long bucket[PROF_BUCKETS];
+};
+
+struct editorProfile //Ctrl-P / KILO_PROFILE
+{
+	int on; //collecting
+	int overlay; //showing in the message bar
+	long t_key; //when the key being handled was read, 0 = none
+	struct profHist lat; //key read -> frame written
+	struct profHist key; //key read -> redraw starts
+	struct profHist draw; //building the frame
+	struct profHist write; //handing it to the terminal
+	long frames, bytes; //frames written and their bytes
+	long rows_rendered, rows_hl;
+	const char *dump; //report goes here on exit
+};
+
+struct editorBufferState //the part of E that belongs to one buffer, parked here while another is being edited
+{
+	int cx, cy, rx, farx;
+	int rowoff, coloff;
+	int numrows, rowcap;
+	erow *row;
+	erowdraw *rowdraw;
+	struct editorArena arena;
+	int dirty;
+	editorUndoOp *undo;
+	int undolen, undocap;
+	int hl_from, hl_nstale;
+	int cache_hit;
+	char *filename;
+	struct editorSyntax *syntax;
+	int grep_view, grep_sel;
+	int match_row, match_at, match_len;
+	off_t disk_size;
+	dev_t disk_dev;
+	ino_t disk_ino;
+	struct timespec disk_mtime;
+	uint64_t *disk_hash;
+	int disk_lines;
+	int gzip;
+	unsigned char *hex;
+	size_t hex_size;
+	int hex_width;
+	int follow, follow_wd, follow_dwd, follow_partial;
+	int wrap, wrapoff;
+	int *wrap_lines, *wrap_tree;
+	int wrap_cap, wrap_width, wrap_gap;
+	struct editorFolds fold;
+	struct editorBrackets brk;
+};
+
+typedef struct cell //one screen position as the compositor sees it
+{
+	char c[12]; //utf-8 of the char and any combining marks after it
+	unsigned char n; //bytes in c, 0 = right half of a wide char
+	unsigned char color; //SGR foreground, 0 = default
+	unsigned char inverse;
+	unsigned char pad;
+} cell;
+
+typedef struct editorPane //a viewport onto a buffer
+{
+	int top, left; //screen position of its first text row
+	int rows, cols; //text area, its status line is the row under it
+	int buf; //buffer shown, -1 = no buffer list
+	int cx, cy, rx, farx, rowoff, coloff; //the focused pane keeps these in E
+	int wrapoff;
+} editorPane;
+
+typedef struct editorBuffer //one entry of the buffer list
+{
+	char *path; //what to load on the first visit, NULL = unnamed
+	int loaded;
+	struct editorBufferState st; //stale while this is the current buffer, E has it
+} editorBuffer;
+
+typedef struct editorClient //a terminal attached to kilo --server
+{
+	int fd; //socket, frames go out on it too
+	int dead; //hung up or detached, dropped at the end of the loop
+	int rows, cols; //size it last reported, 0 = not told yet
+	char *open; //path it asked for, not switched to yet
+	char *raw; //bytes off the socket that aren't a whole message yet
+	int rawlen, rawcap;
+	char *keys; //keystrokes waiting for editorReadKey
+	int keylen, keypos, keycap;
+
+	//its screen, in E while it's the current client
+	int termrows, termcols;
+	editorPane *panes;
+	int npanes, panecap, curpane;
+	cell *screen, *shown;
+	int screencells, shown_valid;
+	char statusmsg[80];
+	time_t statusmsg_time;
+} editorClient;
+
 struct editorConfig {
 	//cursor tracking
 	int cx, cy;
@@ -128,11 +453,81 @@ struct editorConfig {
 	int rowoff;
 	int coloff;
 	int numrows;
+	int rowcap; //allocated size of row and rowdraw
 	erow *row;
+	erowdraw *rowdraw; //render side of row[i]
+	struct editorArena arena; //row storage
 
 	//editing status
 	int dirty;
 
+	//undo log
+	editorUndoOp *undo;
+	int undolen;
+	int undocap;
+	int undo_group; //bumped once per keypress
+	int undo_suspended; //>0 while loading files or undoing
+
+	//background highlighting. lock guards all of E, the main thread holds it except while waiting for input
+	pthread_mutex_t lock;
+	pthread_cond_t hl_cond;
+	int hl_from; //lowest row queued for the worker, INT_MAX = none
+	int hl_nstale; //rows with hl_stale set
+	int hl_defer; //>0 = queue rows instead of highlighting them here (file loads)
+	int hl_repaint; //worker published a row that's on screen
+	unsigned int hlver; //last version handed to a row
+
+	//highlight cache
+	int cache_hit; //rows and colors came from the cache, nothing new to store
+
+	//the file as of the last read or write
+	off_t disk_size;
+	dev_t disk_dev;
+	ino_t disk_ino;
+	struct timespec disk_mtime;
+	uint64_t *disk_hash; //per line, the base a reload merges against. NULL = not known
+	int disk_lines;
+	int gzip; //file on disk is gzip, save compresses it again
+
+	//hex view (binary files, Ctrl-X), the file stays mapped and has no rows
+	unsigned char *hex; //NULL = rows as usual
+	size_t hex_size;
+	int hex_width; //bytes per line, 16 or 32
+	int hex_want; //next editorOpen: 0 = look at the bytes, 1 = hex, -1 = text
+
+	//soft wrap (Ctrl-V), rows fold at the pane width instead of scrolling sideways
+	int wrap;
+	int wrapoff; //which of rowoff's visual lines is at the top
+	int *wrap_lines; //visual lines of each row's slot, kept by editorRenderRowFrom. gap slots hold 0
+	int *wrap_tree; //Fenwick sums of wrap_lines, 1 based
+	int wrap_cap; //slots in wrap_lines (wrap_tree has one more)
+	int wrap_width; //pane width wrap_tree counts lines for, 0 = every row is recounted at the next draw
+	int wrap_gap; //rows before it have slot = row, the rest sit the wrap_cap - numrows gap slots further right
+
+	//code folding, a closed fold shows as its first row
+	struct editorFolds fold;
+
+	//bracket matching, the pair at the cursor is drawn inverted and Ctrl-] jumps across
+	struct editorBrackets brk;
+	int pair_row[2], pair_at[2]; //the one at the cursor and its partner (render pos), -1 = none
+
+	struct editorGzipJob gzjob; //the last .gz save, shared by every buffer
+	int key_top; //editorProcessKeypress is waiting, idle checks that need the whole editor can run
+	int key_held; //key that cut a utf-8 char short, handled next. 0 = none
+
+	//follow mode (Ctrl-T), appended lines are read in as they're written
+	int follow;
+	int follow_wd, follow_dwd; //inotify watches on the file and its directory
+	int follow_partial; //last row had no newline yet, the next bytes continue it
+	int inotify_fd; //-1 until something is followed, shared by every buffer
+
+	//kilo -, rows read from a pipe as they come
+	struct editorStream stream;
+
+	//find overlay, drawn over the row's spans
+	int match_row; //-1 = none
+	int match_at, match_len; //render range
+
 	//status bar
 	char *filename;
 	char statusmsg[80];
@@ -141,8 +536,45 @@ struct editorConfig {
 	//syntax settings
 	struct editorSyntax *syntax;
 
+	//grep results
+	grepMatch *grep;
+	int grepnum;
+	int grep_view; //results list is what's on screen
+	int grep_sel; //last result opened
+	char *grep_query;
+
 	//terminal settings
 	struct termios orig_termios;
+	int outfd; //frames go here, the terminal unless replaying
+	int record_fd; //--record, every byte read from the terminal is copied here. -1 = off
+	struct editorReplay replay;
+
+	//profiler
+	struct editorProfile prof;
+
+	//panes and the compositor. screenrows/screencols above are the focused pane's text area
+	int termrows, termcols;
+	editorPane *panes;
+	int npanes, panecap, curpane;
+	cell *screen; //frame being composed
+	cell *shown; //what the terminal has
+	int screencells; //termrows * termcols the grids were made for
+	int shown_valid; //0 = terminal contents unknown, clear and send everything
+
+	//buffer list, the current one lives in the fields above
+	editorBuffer *bufs;
+	int nbufs, bufcap;
+	int curbuf; //-1 = no list, E is all there is
+
+	//kilo --server, the current client's screen lives in the fields above
+	editorClient *clients;
+	int nclients, clientcap;
+	int curclient; //-1 = none, input comes from the terminal
+	int listenfd;
+
+	//memory accounting
+	struct memStat mem[MEM_TAGS];
+	const char *mem_dump; //KILO_MEMREPORT, report goes here on exit
 };
 
 //Global Data
@@ -178,7 +610,68 @@ void clearScreen();
 void editorSetStatusMessage(const char *fmt, ...);
 void editorRefreshScreen();
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorPromptEx(char *prompt, void (*callback)(char *, int), int allow_empty);
 int editorRowRXtoCX(erow *r, int rx);
+int editorRowCxToRx(erow *r, int cx);
+erowdraw *editorRowDraw(erow *row);
+void editorUndoPush(int type, int row, int col, int c, char *text, int len, int cap);
+void *arenaRealloc(struct editorArena *a, void *p, size_t oldsize, size_t size, int *cap);
+void editorHlQueue(int at);
+void editorHlDone(erow *row);
+void editorMoveCursor(int key);
+void editorSetFarx();
+int editorOpen(char *filename);
+void editorReplayKeyStart(int c);
+void editorReplayKeyEnd();
+void editorReplayFrame(int bytes);
+void editorPanesReady();
+void editorPaneSave(editorPane *p);
+void editorPaneLoad(editorPane *p);
+void editorBufferSwap(int n);
+int editorClientReadByte(char *c);
+int editorFollowPoll();
+int editorStreamPoll();
+int editorGzipSaved();
+void editorHexDrawRows(editorPane *p);
+void editorWrapRow(erow *row);
+int editorWrapStart(int row, int seg);
+void editorWrapShift(int at, int n);
+int editorWrapDrawStart(int *seg);
+int editorWrapLines(int row);
+void editorWrapScroll();
+void editorWrapCursor(int *y, int *x);
+void editorWrapMove(int key);
+void editorFoldShift(int at, int n);
+void editorFoldRewrap();
+int editorFoldShown(int row);
+int editorFoldLine(int row);
+int editorFoldRow(int v);
+int editorFoldNext(int row);
+int editorFoldPrev(int row);
+int editorFoldHeader(int row);
+void editorFoldReveal();
+void editorFoldScroll();
+void editorFoldSurface();
+void editorBracketSum(erowdraw *row, brsum *s);
+void editorBracketRow(erow *row);
+void editorBracketShift(int at, int n);
+void editorBracketFree();
+void editorBracketPair();
+int editorBracketOpener(int row, int t);
+void editorFollowStop();
+void editorHexClamp();
+int editorHexCol(int i);
+void editorFollowAppend(const char *s, int len);
+void editorDiskHashRows(int from);
+uint64_t editorRowHash(erow *row);
+int editorDiskChanged();
+void editorDiskReload();
+void editorFollowToggle();
+void editorClientDetach();
+long editorProfNow();
+void *memRealloc(int tag, void *p, size_t oldsize, size_t size);
+void memFree(int tag, void *p, size_t size);
+void memCount(int tag, long delta);
 
 #pragma endregion
 
@@ -235,27 +728,68 @@ void enableRawMode()//Change Terminal Attributes to enable "RAW MODE"
 	if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr"); //Set terminal to modified 'raw' state
 }
 
+int editorReadByte(char *c) //next input byte, from the replay script or a server client if there is one. returns like read()
+{
+	if (E.curclient >= 0) return editorClientReadByte(c);
+	if (E.replay.keys)
+	{
+		if (E.replay.pos == E.replay.len) return 0;
+		*c = E.replay.keys[E.replay.pos++];
+		return 1;
+	}
+	int nread = read(STDIN_FILENO, c, 1);
+	if (nread == 1 && E.record_fd != -1 && write(E.record_fd, c, 1) != 1) die("record");
+	return nread;
+}
+
+int editorWaitByte(char *c) //editorReadByte for the first byte of a key, rows arriving on stdin cut the wait short
+{
+	if (E.stream.buf >= 0 && E.curclient < 0 && !E.replay.keys)
+	{
+		struct pollfd pfd[2] = {{STDIN_FILENO, POLLIN, 0}, {E.stream.wake[0], POLLIN, 0}};
+		if (poll(pfd, 2, 100) <= 0 || !(pfd[0].revents & POLLIN)) return 0; //same as a VTIME timeout
+	}
+	return editorReadByte(c);
+}
+
 int editorReadKey() //input handling
 {
 	int nread; //bytes read
 	char c; //curr char read
+	if (E.replay.keys) editorReplayKeyEnd(); //whatever the last key set off is done
 	//Spin lock till c is valid character
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1) //spin lock till valid character
+	pthread_mutex_unlock(&E.lock); //the highlight worker gets E while we wait
+	while ((nread = editorWaitByte(&c)) != 1) //spin lock till valid character
 	{
 		if (nread == -1 && errno != EAGAIN) die("read"); //Ignore Timeout, Error Handling
+		if (nread == 0 && E.replay.keys) exit(0); //script ran out, the report is an atexit handler
+		pthread_mutex_lock(&E.lock);
+		if (E.key_top && editorDiskChanged()) return DISK_CHANGED; //with E.lock held, like any key
+		int more = editorFollowPoll();
+		more |= editorStreamPoll();
+		more |= editorGzipSaved();
+		if (E.hl_repaint || more) //new colors or new lines on screen
+		{
+			E.hl_repaint = 0;
+			editorRefreshScreen();
+		}
+		pthread_mutex_unlock(&E.lock);
 	}
+	if (E.prof.on) E.prof.t_key = editorProfNow();
+	pthread_mutex_lock(&E.lock);
+	if (E.replay.keys) editorReplayKeyStart((unsigned char)c);
 	if(c == '\x1b') //c is Escape Seq
 	{
 		char seq[3]; //max special command length
 		
 		//3 > valid command >= 2
-		if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b'; 
-		if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+		if (editorReadByte(&seq[0]) != 1) return '\x1b'; 
+		if (editorReadByte(&seq[1]) != 1) return '\x1b';
 		if (seq[0] == '[') //[%d~ logic
 		{
 			if (seq[1] >= '0' && seq[1] <= '9') //Command req 3rd input
 			{
-				if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b'; //No read No Command
+				if (editorReadByte(&seq[2]) != 1) return '\x1b'; //No read No Command
 				if (seq[2] == '~')//Command struct [%d~, [0-9]
 				{
 					switch (seq[1]) //command -> key
@@ -290,7 +824,7 @@ int editorReadKey() //input handling
 
 		return '\x1b'; //No command Return Escape Char
 	} 
-	return c; //Non-Command char
+	return (unsigned char)c; //Non-Command char, unsigned so utf-8 bytes stay positive
 }
 
 int getCursorPosition(int *rows, int *cols) //Get Cursor Posiition in Window | Pass back rowXcol posiiton
@@ -311,8 +845,8 @@ int getCursorPosition(int *rows, int *cols) //Get Cursor Posiition in Window | P
 
 void clearScreen() //erases terminal screen
 {
-	write(STDOUT_FILENO, "\x1B[2J", 4); //Erase Entire Screen
-	write(STDOUT_FILENO, "\x1b[H", 3); //Place Cursor Top Left
+	write(E.outfd, "\x1B[2J", 4); //Erase Entire Screen
+	write(E.outfd, "\x1b[H", 3); //Place Cursor Top Left
 }
 
 int getWindowSize(int *rows, int *cols) //grab window size from os, pass back hxw or rxc
@@ -335,82 +869,273 @@ int getWindowSize(int *rows, int *cols) //grab window size from os, pass back hx
 
 #pragma endregion
 
+#pragma region /*** UTF-8 ***/
+
+struct editorRange
+{
+	int lo, hi;
+};
+
+//common combining/format ranges, drawn with no width (not the full Unicode tables)
+static const struct editorRange zero_width[] = {
+	{0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+	{0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+	{0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711},
+	{0x0730, 0x074A}, {0x07A6, 0x07B0}, {0x0816, 0x0819}, {0x0900, 0x0902}, {0x093A, 0x093A},
+	{0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963},
+	{0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+	{0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0x302A, 0x302D},
+	{0x3099, 0x309A}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF},
+	{0xE0000, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+//east asian wide and emoji ranges, drawn 2 columns wide
+static const struct editorRange double_width[] = {
+	{0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+	{0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+	{0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+	{0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+	{0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+	{0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+	{0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+	{0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+	{0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+	{0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4}, {0x17000, 0x18AFF}, {0x1B000, 0x1B2FF},
+	{0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251},
+	{0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+	{0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+#define UTF8_ZWJ 0x200D
+
+int editorInRange(const struct editorRange *r, int n, int cp) //binary search a sorted range table
+{
+	int lo = 0, hi = n - 1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (cp < r[mid].lo) hi = mid - 1;
+		else if (cp > r[mid].hi) lo = mid + 1;
+		else return 1;
+	}
+	return 0;
+}
+
+int editorCharWidth(int cp) //columns a codepoint takes, -1 (bad byte) and controls draw as 1
+{
+	if (cp < 0x300) return 1; //ascii, latin, controls, bad bytes
+	if (editorInRange(zero_width, sizeof(zero_width) / sizeof(zero_width[0]), cp)) return 0;
+	if (editorInRange(double_width, sizeof(double_width) / sizeof(double_width[0]), cp)) return 2;
+	return 1;
+}
+
+int editorUtf8Decode(const char *s, int len, int *cp) //decode one char, returns bytes used. bad bytes come back one at a time as *cp = -1
+{
+	unsigned char c = s[0];
+	if (c < 0x80)
+	{
+		*cp = c;
+		return 1;
+	}
+	int n = (c >= 0xC2 && c < 0xE0) ? 2 : (c >= 0xE0 && c < 0xF0) ? 3 : (c >= 0xF0 && c < 0xF5) ? 4 : 0;
+	if (n == 0 || n > len)
+	{
+		*cp = -1;
+		return 1;
+	}
+	int v = c & (0x7F >> n);
+	for (int i = 1; i < n; i++)
+	{
+		unsigned char cc = s[i];
+		if ((cc & 0xC0) != 0x80) //not a continuation byte
+		{
+			*cp = -1;
+			return 1;
+		}
+		v = (v << 6) | (cc & 0x3F);
+	}
+	if ((n == 3 && v < 0x800) || (n == 4 && (v < 0x10000 || v > 0x10FFFF)) || (v >= 0xD800 && v <= 0xDFFF)) //overlong or surrogate
+	{
+		*cp = -1;
+		return 1;
+	}
+	*cp = v;
+	return n;
+}
+
+int editorFirstHighByte(const char *s, int len) //index of the first byte >= 0x80, -1 if s is all ASCII
+{
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) //16 bytes per test, movemask collects the high bits
+	{
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+#else
+	for (; i + 8 <= len; i += 8) //8 bytes per test
+	{
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		if (w & 0x8080808080808080ULL) break;
+	}
+#endif
+	for (; i < len; i++) if (s[i] & 0x80) return i;
+	return -1;
+}
+
+#pragma endregion
+
 #pragma region /***Syntax Highlighting ***/
 
 int is_seperator(int c) //checks if c is a seperating character
 {
-	return isspace(c) || c == '\0' || strchr(",.()+=/*=~%%<>[];", c); //checks if char is a space, end of line (eol) or in string def last
+	return isspace((unsigned char)c) || c == '\0' || strchr(",.()+=/*=~%%<>[];", c); //checks if char is a space, end of line (eol) or in string def last
+}
+
+void editorHlPaint(struct editorArena *a, erowdraw *row, int off, int len, int hl) //color render[off..off+len), painting only ever moves right so it appends or extends the last span
+{
+	while (len > 0)
+	{
+		hlspan *last = row->nhl ? &row->hl[row->nhl - 1] : NULL;
+		if (last && last->hl == hl && last->off + last->len == off && last->len < 65535) //extend the run
+		{
+			int n = 65535 - last->len < len ? 65535 - last->len : len;
+			last->len += n;
+			off += n;
+			len -= n;
+			continue;
+		}
+		if ((int)sizeof(hlspan) * (row->nhl + 1) > row->hlcap)
+		{
+			int want = sizeof(hlspan) * (row->nhl ? row->nhl * 2 : 2);
+			row->hl = arenaRealloc(a, row->hl, row->hlcap, want, &row->hlcap);
+		}
+		int n = len < 65535 ? len : 65535;
+		row->hl[row->nhl].off = off;
+		row->hl[row->nhl].len = n;
+		row->hl[row->nhl].hl = hl;
+		row->nhl++;
+		off += n;
+		len -= n;
+	}
 }
 
-void editorUpdateSyntax(erow *row) //update styling string for a row
+int editorHlSpanAt(erowdraw *row, int at) //index of the last span starting at or before render pos at, -1 if none
 {
-	row->hl = realloc(row->hl, row->rsize); //allocate HL enough mem to store encodings for entire rendered string
-	memset(row->hl, HL_NORMAL, row->rsize); //Iniitally set HL to have every char normal color
+	int lo = 0, hi = row->nhl - 1, found = -1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (row->hl[mid].off <= at)
+		{
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return found;
+}
 
-	if (E.syntax == NULL) return; //no HL guide so leave normal
+int editorHighlightRowIn(erowdraw *row, int from, int in_comment, struct editorSyntax *syntax, struct editorArena *a) //update styling spans for a single row from render pos 'from' on,
+{ //in_comment = previous row left a comment open, spans come from a. returns 1 if it leaves one open itself
+	if (syntax == NULL) //no HL guide so leave normal
+	{
+		row->nhl = 0;
+		return 0;
+	}
 
-	char **keywords = E.syntax->keywords;
+	char **keywords = syntax->keywords;
 
-	char *scs = E.syntax->singeline_comment_start; //grabas the scs char
+	char *scs = syntax->singeline_comment_start; //grabas the scs char
 	int scs_len = scs ? strlen(scs) : 0; //sets the len of our scs char
 	
-	char *mcs = E.syntax->multiline_comment[0]; //mlcs char
+	char *mcs = syntax->multiline_comment[0]; //mlcs char
 	int mcs_len = mcs ? strlen(mcs) : 0; //sets the len of our mlcs char
-	char *mce = E.syntax->multiline_comment[1]; //mce char
+	char *mce = syntax->multiline_comment[1]; //mce char
 	int mce_len = mce ? strlen(mce) : 0; //sets the len of our mce char
 
 	int prev_sep = 1; //starts as true every line
 	int in_string = 0; //mark start of string
-	int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
 	
-
+	/* Resume point: the last plain separator far enough before 'from' that
+	   nothing it looked at changed. Past one of those we're outside any
+	   string/comment/keyword with prev_sep set, same as a fresh line. */
 	int i = 0;
+	if (from > 0)
+	{
+		int win = scs_len > mcs_len ? scs_len : mcs_len;
+		int q = from - (win > 1 ? win : 1);
+		if (q >= row->rsize) q = row->rsize - 1;
+		int s = editorHlSpanAt(row, q);
+		while (q >= 0)
+		{
+			if (s >= 0 && q < row->hl[s].off + row->hl[s].len) //colored, skip the whole run
+			{
+				q = row->hl[s].off - 1;
+				s--;
+				continue;
+			}
+			if (is_seperator(row->render[q])) break;
+			q--;
+		}
+		if (q >= 0)
+		{
+			i = q + 1;
+			in_comment = 0;
+		}
+	}
+	row->nhl = editorHlSpanAt(row, i - 1) + 1; //keep the runs before i, everything from i on starts out normal
+	if (row->nhl && row->hl[row->nhl - 1].off + row->hl[row->nhl - 1].len > i) row->hl[row->nhl - 1].len = i - row->hl[row->nhl - 1].off;
+	int start = i;
+
 	while(i < row->rsize){
-		char c = row->render[i]; //char to check
-		unsigned char prev_hl = (i > 0) ? row->hl[i-1] : HL_NORMAL; //index last char if possible
+		unsigned char c = row->render[i]; //char to check (unsigned so utf-8 bytes don't go negative)
+		unsigned char prev_hl = HL_NORMAL; //color of the last char, only this pass's runs can touch it
+		if (i > start && row->nhl && row->hl[row->nhl - 1].off + row->hl[row->nhl - 1].len == i) prev_hl = row->hl[row->nhl - 1].hl;
 
 		if (scs_len && !in_string && !in_comment) //checks that we have a scs char and our outside a string
 		{
 			if (!strncmp(&row->render[i], scs, scs_len)) //checks curr pos if it's a scs
 			{
-				memset(&row->hl[i], HL_COMMENT, row->rsize - i); //sets row from scs on to common color
+				editorHlPaint(a, row, i, row->rsize - i, HL_COMMENT); //sets row from scs on to common color
 				break;
 			}
 		}
 
 		if (mcs_len && mce_len && !in_string){
 			if (in_comment){
-					row->hl[i] = HL_MLCOMMENT;
 					if (!strncmp(&row->render[i], mce, mce_len)){
-						memset(&row->hl[i], HL_MLCOMMENT, mce_len);
+						editorHlPaint(a, row, i, mce_len, HL_MLCOMMENT);
 						i += mce_len;
 						in_comment = 0; //check if mlce char
 						prev_sep = 1;
 						continue;
 					} else {
+						editorHlPaint(a, row, i, 1, HL_MLCOMMENT);
 						i++;
 						continue;
 					}
 						
 			} else if (!strncmp(&row->render[i], mcs, mcs_len)){
-					memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
+					editorHlPaint(a, row, i, mcs_len, HL_MLCOMMENT);
 					i+= mcs_len;
 					in_comment = 1;
 					continue;
 				}
 		}
 
-		if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) //check string flag
+		if (syntax->flags & HL_HIGHLIGHT_STRINGS) //check string flag
 		{
 			if (in_string){ //curr in string
-				row->hl[i] = HL_STRING; //hl string
-				
 				if (c == '\\' && i + 1 < row->rsize) { //handle \" and \' withiin a string
-					row->hl[i+1] = HL_STRING;
+					editorHlPaint(a, row, i, 2, HL_STRING);
 					i+=2;
 					continue;
 				}
 
+				editorHlPaint(a, row, i, 1, HL_STRING); //hl string
 				if (c == in_string) in_string = 0; //hit " or ' so end of string
 				i++; //increment
 				prev_sep = 1; //sep stay true
@@ -419,7 +1144,7 @@ void editorUpdateSyntax(erow *row) //update styling string for a row
 			} else {
 				if (c == '"' || c == '\'') {
 					in_string = c; //string equals " or ' in ascii
-					row->hl[i] = HL_STRING; //color quote
+					editorHlPaint(a, row, i, 1, HL_STRING); //color quote
 					i++; //increment
 					continue;
 				}
@@ -427,12 +1152,12 @@ void editorUpdateSyntax(erow *row) //update styling string for a row
 		}
 
 
-		if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) //check if num hl enabled
+		if (syntax->flags & HL_HIGHLIGHT_NUMBERS) //check if num hl enabled
 		{
 			if (isdigit(c) && (prev_sep || prev_hl == HL_NUMBER || //Check C is number and prev char is either sep or num
 				(c == '.' && prev_hl == HL_NUMBER))) //allow decimals, hl . 
 			{
-				row->hl[i] = HL_NUMBER; //If curr rendered char is num, indicate number coloring in HL styling string
+				editorHlPaint(a, row, i, 1, HL_NUMBER); //If curr rendered char is num, indicate number coloring in HL styling string
 				i++; //increment i
 				prev_sep = 0; //curr hl so no sep
 				continue; //go to next char
@@ -449,7 +1174,7 @@ void editorUpdateSyntax(erow *row) //update styling string for a row
 
 				if (!strncmp(&row->render[i], keywords[j], klen) //check curr index start of keyword
 				&& is_seperator(row->render[i+klen])){ //confirm keyword has sep at end
-					memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen); //set kw color based on kw2 marker
+					editorHlPaint(a, row, i, klen, kw2 ? HL_KEYWORD2 : HL_KEYWORD1); //set kw color based on kw2 marker
 					i+= klen; //iterate past kw and post sep
 					break; //can't continue since it would hit inner loop
 				}
@@ -464,10 +1189,44 @@ void editorUpdateSyntax(erow *row) //update styling string for a row
 		prev_sep = is_seperator(c); //update prev_sep tracker
 		i++; //increment i to iterate through row
 	}
-	//updating open_comment attribute
-	int changed = (row->hl_open_comment != in_comment);
-	row->hl_open_comment = in_comment;
-	if (changed && row->idx + 1 < E.numrows) editorUpdateSyntax(&E.row[row->idx+1]);
+	return in_comment;
+}
+
+int editorHighlightRow(erow *row, int from) //highlight a row of the buffer in place, returns 1 if its open comment state changed
+{
+	if (E.prof.on) E.prof.rows_hl++;
+	int at = row - E.row;
+	int open = editorHighlightRowIn(editorRowDraw(row), from, at > 0 && E.row[at - 1].hl_open_comment, E.syntax, &E.arena);
+	int changed = row->hl_open_comment != open;
+	row->hl_open_comment = open;
+	editorBracketRow(row);
+	return changed;
+}
+
+void editorUpdateSyntaxFrom(erow *row, int from) //update styling for a row from render pos 'from', rows below whose open comment state changes go to the worker
+{
+	int at = row - E.row;
+	if (E.hl_defer)
+	{
+		editorHlQueue(at);
+		return;
+	}
+	if (row->hl_stale) //spans before 'from' can't be trusted either
+	{
+		from = 0;
+		editorHlDone(row);
+	}
+	if (editorHighlightRow(row, from) && at + 1 < E.numrows) editorHlQueue(at + 1);
+}
+
+void editorUpdateSyntax(erow *row) //update styling for a whole row
+{
+	editorUpdateSyntaxFrom(row, 0);
+}
+
+void editorUpdateSyntaxRange(int first, int last) //queue rows first..last for the worker, it keeps going while comment state changes
+{
+	for (int i = first; i <= last && i < E.numrows; i++) editorHlQueue(i);
 }
 
 
@@ -491,6 +1250,14 @@ void editorSelectSyntaxHighlight() //searches for HLDB entry based on filetype
 	if (E.filename == NULL) return; //no filename
 
 	char *ext = strrchr(E.filename, '.'); //grab pointer to last .
+	size_t extlen = ext ? strlen(ext) : 0;
+	if (ext && !strcmp(ext, ".gz")) //x.c.gz goes by the .c
+	{
+		char *gz = ext;
+		while (ext > E.filename && ext[-1] != '.' && ext[-1] != '/') ext--;
+		ext = (ext > E.filename && ext[-1] == '.') ? ext - 1 : NULL;
+		extlen = ext ? (size_t)(gz - ext) : 0;
+	}
 	for (unsigned int j = 0; j < HLDB_ENTRIES; j++) //iterate through hldb entries
 	{
 		struct editorSyntax *s = &HLDB[j]; //local copy of curr hldb entry
@@ -498,16 +1265,12 @@ void editorSelectSyntaxHighlight() //searches for HLDB entry based on filetype
 		while (s->filematch[i]) //iterate through entrie's accepted filetypes
 		{
 			int is_ext = (s->filematch[i][0] == '.'); //makes sure ext has a .
-			if ((is_ext && ext && !strcmp(ext, s->filematch[i])) //if curr filematch is ext, ext eists, and is match
+			if ((is_ext && ext && !strncmp(ext, s->filematch[i], extlen) && !s->filematch[i][extlen]) //if curr filematch is ext, ext eists, and is match
 			|| (!is_ext && strstr(E.filename, s->filematch[i])) //currfilematch isn't an extension, but filename is a substring of supported filetype
 			) {
 				E.syntax = s; //set syntax to matching entry
 
-				int filerow;
-				for (filerow = 0; filerow < E.numrows; filerow++)//iterate through all rows
-				{
-					editorUpdateSyntax(&E.row[filerow]); //update all rows to match hl guide
-				}
+				editorUpdateSyntaxRange(0, E.numrows - 1); //update all rows to match hl guide
 				return;
 			}
 			i++; //inrement to next filetype
@@ -522,775 +1285,6730 @@ void editorSelectSyntaxHighlight() //searches for HLDB entry based on filetype
 struct abuf{
 	char *b;
 	int len;
+	int cap; //bytes allocated, doubles so a frame of one cell appends reallocs a handful of times
 };
 
-#define ABUF_INIT {NULL, 0}
+#define ABUF_INIT {NULL, 0, 0}
 
 void abAppend(struct abuf *ab, char *s, int len){
-	//allocate mem to hold old and new string
-	char *new = realloc(ab->b, ab->len + len);
-	
-	//err handle if realloc fail
-	if(new == NULL) return;
+	if (ab->len + len > ab->cap) //allocate mem to hold old and new string
+	{
+		int cap = ab->cap ? ab->cap : 4096;
+		while (cap < ab->len + len) cap *= 2;
+		char *new = memRealloc(MEM_ABUF, ab->b, ab->cap, cap);
+
+		//err handle if realloc fail
+		if(new == NULL) return;
+		ab->b = new;
+		ab->cap = cap;
+	}
 
 	//copy the new string to the end of the old one
-	memcpy(&new[ab->len], s, len);
-
-	//set abuf to bethe new string pointer an dlength
-	ab->b = new;
+	memcpy(&ab->b[ab->len], s, len);
 	ab->len += len;
 }
 
 void abFree(struct abuf *ab){
-	free(ab->b);
+	memFree(MEM_ABUF, ab->b, ab->cap);
 }
 #pragma endregion
 
-#pragma region //Row Operations
+#pragma region /*** Row Allocator ***/
 
-char *editorRowsToString(int *buflen) //Editor representation -> Buf
+//rows are lots of small strings that mostly live and die together, so they come from size class slabs
+//instead of one malloc each: no per block header, and dropping a buffer frees a handful of chunks
+
+int arenaClass(size_t size) //size class of a block, size <= ARENA_MAX_BLOCK
 {
-	int totlen = 0; //buf length var
-	int i; //loop counter
-	for (i = 0; i < E.numrows; i++) totlen += E.row[i].size + 1; //iterate through all rows, sum length of all rows
-	*buflen = totlen; //set buf length to totlen
+	if (size <= 128) return size ? (int)(size - 1) / 16 : 0;
+	int shift = 31 - __builtin_clz((unsigned)(size - 1)); //2^shift < size <= 2^(shift+1)
+	size_t p = (size_t)1 << shift;
+	return 8 + (shift - 7) * 4 + (int)((size - p - 1) / (p / 4));
+}
 
-	char *buf = malloc(totlen); //assign buf enough memory to hold all row data
-	char *p = buf; //local var to manipulate buf which will be passed up to parent
+size_t arenaClassSize(int k) //bytes in a block of class k
+{
+	if (k < 8) return (size_t)(k + 1) * 16;
+	size_t p = (size_t)128 << ((k - 8) / 4);
+	return p + ((k - 8) % 4 + 1) * (p / 4);
+}
 
-	for (i = 0; i < E.numrows; i++) //iterate through all rows
+size_t arenaMallocCost(size_t size) //what glibc malloc would really hold for size bytes (8 byte header, 16 byte align, 32 min)
+{
+	size_t n = (size + 8 + 15) & ~(size_t)15;
+	return n < 32 ? 32 : n;
+}
+
+void *arenaAlloc(struct editorArena *a, size_t size, int *cap) //block of at least size bytes, *cap gets how much it really holds
+{
+	a->allocs++;
+	a->blocks++;
+	if (size > ARENA_MAX_BLOCK) //too big to slab, keep it on the large list so release still finds it
 	{
-		memcpy(p, E.row[i].chars, E.row[i].size); //copy curr row to buf
-		p += E.row[i].size; //increment p index to end of curr row/line
-		*p = '\n'; //append '\n' to seperate written lines
-		p++; //increment p to nexxt free index.
+		struct arenaLarge *l = malloc(sizeof(struct arenaLarge) + size);
+		l->size = size;
+		l->prev = NULL;
+		l->next = a->large;
+		if (a->large) a->large->prev = l;
+		a->large = l;
+		a->reserved += sizeof(struct arenaLarge) + size;
+		a->inuse += size;
+		a->mallocequiv += arenaMallocCost(size);
+		*cap = size;
+		return l + 1;
 	}
-	return buf; //return buffer containing all informatoin held by editor
+
+	int k = arenaClass(size);
+	size_t n = arenaClassSize(k);
+	void *p = a->freelist[k];
+	if (p) a->freelist[k] = *(void **)p; //reuse a freed block
+	else
+	{
+		if (!a->chunks || a->chunks->used + n > ARENA_CHUNK) //start a new chunk, the old one's tail is left unused
+		{
+			struct arenaChunk *c = malloc(sizeof(struct arenaChunk) + ARENA_CHUNK);
+			c->next = a->chunks;
+			c->used = 0;
+			a->chunks = c;
+			a->reserved += sizeof(struct arenaChunk) + ARENA_CHUNK;
+		}
+		p = a->chunks->data + a->chunks->used;
+		a->chunks->used += n;
+	}
+	a->inuse += n;
+	a->mallocequiv += arenaMallocCost(n);
+	*cap = n;
+	return p;
 }
 
-void editorUpdateRow(erow *row) //updates 'rendered' row and highlight scheme
+void arenaFree(struct editorArena *a, void *p, size_t size) //give back a block, size = the cap it was handed out with
 {
-  	int tabs = 0; //tab counter
-	int i; //loop counter
-	for (i = 0; i < row->size; i++) //loop through all chars in row
-	if (row->chars[i] == '\t') tabs++; //count tabs in row
-	free(row->render); //free frs
-	row->render = malloc(row->size + tabs*(KILO_TAB_STOP - 1) + 1); //allocate '\0', tabs (8), chars (1)ea.
-	int idx = 0; //render string index var
-	for (i = 0; i < row->size; i++) //iterate through all char in row
+	if (!p) return;
+	a->frees++;
+	a->blocks--;
+	if (size > ARENA_MAX_BLOCK)
 	{
-	if (row->chars[i] == '\t') //check char is tab
+		struct arenaLarge *l = (struct arenaLarge *)p - 1;
+		if (l->prev) l->prev->next = l->next;
+		else a->large = l->next;
+		if (l->next) l->next->prev = l->prev;
+		a->reserved -= sizeof(struct arenaLarge) + l->size;
+		a->inuse -= l->size;
+		a->mallocequiv -= arenaMallocCost(l->size);
+		free(l);
+		return;
+	}
+	int k = arenaClass(size);
+	*(void **)p = a->freelist[k];
+	a->freelist[k] = p;
+	a->inuse -= arenaClassSize(k);
+	a->mallocequiv -= arenaMallocCost(arenaClassSize(k));
+}
+
+void *arenaRealloc(struct editorArena *a, void *p, size_t oldsize, size_t size, int *cap) //grow a block, keeps its contents
+{
+	if (p && size <= oldsize)
 	{
-		row->render[idx++] = ' '; //'render' 8 total spaces for tab
-		while (idx % KILO_TAB_STOP != 0) row->render[idx++] = ' '; //7 tab space renderer & idx incrementer
-	} else {
-		row->render[idx++] = row->chars[i]; //'render' char increment idx
+		*cap = oldsize;
+		return p;
+	}
+	void *q = arenaAlloc(a, size, cap);
+	if (p) memcpy(q, p, oldsize);
+	arenaFree(a, p, oldsize);
+	return q;
+}
+
+void arenaRelease(struct editorArena *a) //drop everything at once, no per block frees
+{
+	while (a->chunks)
+	{
+		struct arenaChunk *next = a->chunks->next;
+		free(a->chunks);
+		a->chunks = next;
 	}
+	while (a->large)
+	{
+		struct arenaLarge *next = a->large->next;
+		free(a->large);
+		a->large = next;
 	}
-	row->render[idx] = '\0';//terminate 'rendered' string
-	row->rsize = idx; //'render' size = last 'render' index
+	memset(a, 0, sizeof(*a));
+}
 
-	editorUpdateSyntax(row); //create highlight scheme for row
+char *editorArenaDup(const char *s, int len, int *cap) //copy of s[0..len) in row storage, '\0' terminated
+{
+	char *d = arenaAlloc(&E.arena, len + 1, cap);
+	memcpy(d, s, len);
+	d[len] = '\0';
+	return d;
 }
 
-void editorInsertRow(int at, char *s, size_t len) //create and insert erow
+void editorFormatBytes(char *buf, size_t n) //human readable size
 {
-	if (at < 0 || at > E.numrows) return; //return if currRow outside allocated row range [0-numrows]
+	if (n >= 1 << 30) snprintf(buf, 16, "%.1fG", n / (double)(1 << 30));
+	else if (n >= 1 << 20) snprintf(buf, 16, "%.1fM", n / (double)(1 << 20));
+	else if (n >= 1 << 10) snprintf(buf, 16, "%.1fK", n / (double)(1 << 10));
+	else snprintf(buf, 16, "%zuB", n);
+}
+
+#pragma endregion
 
-	E.row = realloc(E.row, ((E.numrows + 1) * sizeof(erow))); //give Editor row pointer space to point to new erow
-	memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at)); //open up gap @ at for new erow
-	for (int j = at + 1; j <= E.numrows; j++) E.row[j].idx++; //update displaced idx rows
+#pragma region /*** Memory Accounting ***/
 
-	E.row[at].idx = at;
-	
-	E.row[at].size = len; //set new erow's internal len
-	E.row[at].chars = malloc(len + 1); //allocate new erows internal string (is)
-	memcpy(E.row[at].chars, s, len); //copy string S to is.
-	E.row[at].chars[len] = '\0'; //set is[len] -> '\0'
-	E.row[at].rsize = 0; //set new rows render size
-	E.row[at].render = NULL; //no rendering applied to row yet
-	E.row[at].hl = NULL; //no stylization applied to row yet
-	E.row[at].hl_open_comment = 0;
+//heap blocks outside the row arena go through memAlloc/memRealloc/memFree with the subsystem they
+//belong to. what's in the arena is attributed by walking the rows and the undo log when a report is
+//asked for, blocks change hands there (row text becomes undo text) so counting at alloc time would lie.
+//Ctrl-A puts the biggest ones in the message bar, KILO_MEMREPORT=FILE writes the table on exit
 
-	editorUpdateRow(&E.row[at]); //updates the row
-	E.numrows++; //trakc new num of rows
-	E.dirty++; //track num of edits made
+const char *mem_names[MEM_TAGS] = {"rows", "undo log", "hl worker", "abuf", "search", "grep", "screen", "disk hashes", "stdin", "wrap index", "folds", "bracket index"};
+
+void memCount(int tag, long delta) //bytes changed hands, allocs counts growth
+{
+	struct memStat *m = &E.mem[tag];
+	m->cur += delta;
+	if (delta > 0) m->allocs++;
+	if (m->cur > m->peak) m->peak = m->cur;
 }
 
-void editorFreeRow(erow *row) //free row struct/object
+void *memAlloc(int tag, size_t size)
 {
-	free(row->render); //free 'visible' format string representation or FRS
-	free(row->chars); //free 'internal' string representation isr.
-	free(row->hl); //free styling string
+	memCount(tag, size);
+	return malloc(size);
 }
 
-void editorDelRow(int at){
-	if(at < 0 || at >= E.numrows) return;
-	editorFreeRow(&E.row[at]);
-	memmove(&E.row[at], &E.row[at+1], sizeof(erow) * (E.numrows - at - 1));
-	for (int j = at + 1; j < E.numrows - 1; j++) E.row[j].idx--; //update displaced idx rows
-	E.numrows--;
-	E.dirty++;
-}
-
-void editorRowInsertChar(erow *row, int at, int c){
-	if (at < 0 || at > row->size) at = row->size;
-	row->chars = realloc(row->chars, row->size + 2);
-	memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-	row->size++;
-	row->chars[at] = c;
-	editorUpdateRow(row);
-	E.dirty++;
+void *memRealloc(int tag, void *p, size_t oldsize, size_t size) //oldsize = what p was allocated with
+{
+	memCount(tag, (long)size - (long)oldsize);
+	return realloc(p, size);
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len){
-	row->chars = realloc(row->chars, row->size + len + 1);
-	memcpy(&row->chars[row->size], s, len); //erase curr null char
-	row->size += len;
-	row->chars[row->size] = '\0';
-	editorUpdateRow(row);
-	E.dirty++;
+void memFree(int tag, void *p, size_t size)
+{
+	if (!p) return;
+	memCount(tag, -(long)size);
+	free(p);
 }
 
-void editorRowDelChar(erow *row, int at){
-	if (at < 0 || at > row->size) return;
-	memmove(&row->chars[at], &row->chars[at+1], row->size - at);
-	row->size--;
-	editorUpdateRow(row);
-	E.dirty++;
-}
+enum memPart { PART_CHARS = MEM_TAGS, PART_RENDER, PART_HL, PART_CHECKPOINTS, PART_UNDO_TEXT, PART_SLACK, MEM_PARTS };
 
-int editorRowCxToRx(erow *r, int cx){
-	int rx = 0;
-	
-	if (cx == 0) {
-		rx += (r->chars[0] == '\t') ? ((KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP)) + 1 : 0;
-		return rx;
-	} 
+const char *part_names[MEM_PARTS - MEM_TAGS] = {"chars", "render", "hl", "checkpoints", "undo text", "arena slack"};
 
-	for (int i = 0; i < cx; i++){
-		rx += (r->chars[i] == '\t') ? ((KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP)) + 1 : 1;
+void editorMemWalkBuffer(long *bytes, erow *rows, erowdraw *draw, int numrows, editorUndoOp *undo, int undolen, struct editorArena *a) //add one buffer's arena
+{
+	long used = 0;
+	for (int i = 0; i < numrows; i++)
+	{
+		erow *row = &rows[i];
+		erowdraw *d = &draw[i];
+		bytes[PART_CHARS] += row->cap; //0 when inline, that's in the rows array
+		bytes[PART_RENDER] += d->rcap; //0 when it shares chars
+		bytes[PART_HL] += d->hlcap;
+		used += row->cap + d->rcap + d->hlcap;
+		if (row->cap && row->u.cp)
+		{
+			int cp = sizeof(struct erowcps) + sizeof(erowcp) * row->u.cp->rxcpcap;
+			bytes[PART_CHECKPOINTS] += cp;
+			used += cp;
+		}
 	}
-
-
-	return rx;
+	for (int i = 0; i < undolen; i++)
+	{
+		bytes[PART_UNDO_TEXT] += undo[i].cap;
+		used += undo[i].cap;
+	}
+	bytes[PART_SLACK] += (long)a->reserved - used; //free lists and unused chunk tails
 }
 
-int editorRowRXtoCX(erow *r, int rx){
-	int cur_rx = 0;
-	int cx;
-
-	for (cx = 0; cx < r->size; cx++){
-		if (r->chars[cx] == '\t') cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-	
-		cur_rx++;
-		
-		if (cur_rx > rx) return cx;
+void editorMemWalk(long *bytes) //current bytes of every tag and arena part over all buffers, bytes has MEM_PARTS slots
+{
+	for (int i = 0; i < MEM_TAGS; i++) bytes[i] = E.mem[i].cur;
+	for (int i = MEM_TAGS; i < MEM_PARTS; i++) bytes[i] = 0;
+	editorMemWalkBuffer(bytes, E.row, E.rowdraw, E.numrows, E.undo, E.undolen, &E.arena);
+	for (int i = 0; i < E.nbufs; i++)
+	{
+		struct editorBufferState *st = &E.bufs[i].st;
+		if (i != E.curbuf && E.bufs[i].loaded) editorMemWalkBuffer(bytes, st->row, st->rowdraw, st->numrows, st->undo, st->undolen, &st->arena);
 	}
+}
 
-	return cx;
+const char *editorMemName(int i){
+	return i < MEM_TAGS ? mem_names[i] : part_names[i - MEM_TAGS];
 }
 
-void editorDrawRows(struct abuf *ab) {
-	int y; //counter var for loops
-	for (y=0; y < E.screenrows; y++) //loop through local 'visible' rows
+void editorMemReport() //Ctrl-A, biggest first, as many as fit
+{
+	long bytes[MEM_PARTS], total = 0;
+	int order[MEM_PARTS], n = 0;
+	editorMemWalk(bytes);
+	for (int i = 0; i < MEM_PARTS; i++)
 	{
-		int filerow = y + E.rowoff; //Global row
-		if(filerow >= E.numrows) //>= Allocatd Rows
+		total += bytes[i];
+		if (bytes[i] <= 0) continue;
+		int j = n++;
+		while (j > 0 && bytes[order[j - 1]] < bytes[i]) //insertion sort, there's a dozen
 		{
-			if (E.numrows == 0 && y == E.screenrows/3) //Check Empty file, Position 1/3 from top
-			{
-				char welcome[80]; //MessageBuf
-				int welcomelen = snprintf(welcome, sizeof(welcome), "Kilo Editor -- version %s", KILO_VERSION); //Editor Version Message, Records Length
-				if (welcomelen > E.screencols) welcomelen = E.screencols; //Truncate len to 'visible' local columns
-				int padding = (E.screencols - welcomelen)/2; //Find Distance to Middle of screen
-				//Place Cursor in middle of screen
-				if (padding){
-					abAppend(ab, "~", 1);
-					padding--;
-				}
-				while(padding--) abAppend(ab, " ", 1);	
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+	}
 
-				abAppend(ab, welcome, welcomelen); //Print Welcome Message
-			} else {
-				abAppend(ab, "~", 1); //Tilda Empty Lines	
-			}
-		} else //Global Row within allocated rows
-		{
-			int len = E.row[filerow].rsize - E.coloff; //set length to available columns
-			if(len < 0) len = 0; //If len < 0, enough columns for whole message
-			if (len > E.screencols) len = E.screencols; //If len > E.screencols, truncate lenght to just num of columns			
-			char *c = &E.row[filerow].render[E.coloff]; //Points to current row's render string
-			unsigned char *hl = &E.row[filerow].hl[E.coloff]; //Pointer to Current Row's HL scheme
-			int current_color = -1; //basic color mem var
-			int j; //loop variable
-			for (j = 0; j < len; j++) //loop through formatted render string (frs)
-			{
-				if (iscntrl(c[j])) //cntrl char processing
-				{
-					char sym = (c[j] <= 26) ? '@' + c[j] : '?'; //render cntrl char as @A etc
-					abAppend(ab, "\x1b[7m", 4); //invert color
-					abAppend(ab, &sym, 1);
-					abAppend(ab, "\x1b[m", 3); //def color
-					if (current_color != -1) //non def color
-					{
-						char buf[16];
-						int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color); //set back to formatted color
-						abAppend(ab, buf, clen);
-					}
+	char msg[sizeof(E.statusmsg)], size[16];
+	editorFormatBytes(size, total);
+	int len = snprintf(msg, sizeof(msg), "mem %s:", size);
+	for (int k = 0; k < n && len < (int)sizeof(msg); k++)
+	{
+		editorFormatBytes(size, bytes[order[k]]);
+		len += snprintf(msg + len, sizeof(msg) - len, " %s %s", editorMemName(order[k]), size);
+	}
+	editorSetStatusMessage("%s", msg);
+}
 
+long editorProcStatus(const char *key) //a kB figure out of /proc/self/status, -1 if there's none
+{
+	FILE *fp = fopen("/proc/self/status", "r");
+	char line[128];
+	long kb = -1;
+	if (!fp) return -1;
+	while (fgets(line, sizeof(line), fp))
+		if (!strncmp(line, key, strlen(key))) kb = atol(line + strlen(key));
+	fclose(fp);
+	return kb;
+}
 
-				} else if (hl[j] == HL_NORMAL) //normal hl
-				{
-					if(current_color != -1) //check if curr color not default
-					{
-						abAppend(ab, "\x1b[39m", 5); //set output to def color
-						current_color = -1;
-					}
-					abAppend(ab, &c[j], 1); //append curr char
-				} else //custom hl
-				{
-					int color = editorSyntaxToColor(hl[j]); //get hl encoding
-					if (color != current_color) //is curr color new color?
-					{
-						current_color = color; //set curr color to new color
-						char buf[16]; //hold set color command
-						int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color); //set buf to color command
-						abAppend(ab, buf, clen); //set color to HL code.
-					}
-					abAppend(ab, &c[j], 1); //append curr char
-				}
-			}
-			abAppend(ab, "\x1b[39m", 5); //set output to def color
+void editorMemDump() //atexit with KILO_MEMREPORT set
+{
+	FILE *fp = fopen(E.mem_dump, "w");
+	if (!fp) return;
+	long bytes[MEM_PARTS], total = 0;
+	editorMemWalk(bytes);
+	char cur[16], peak[16];
+	fprintf(fp, "kilo memory\n%-14s %10s %10s %10s\n", "", "current", "peak", "allocs");
+	for (int i = 0; i < MEM_PARTS; i++)
+	{
+		total += bytes[i];
+		editorFormatBytes(cur, bytes[i] > 0 ? bytes[i] : 0);
+		if (i < MEM_TAGS)
+		{
+			editorFormatBytes(peak, E.mem[i].peak);
+			fprintf(fp, "%-14s %10s %10s %10ld\n", editorMemName(i), cur, peak, E.mem[i].allocs);
 		}
-		abAppend(ab, "\x1b[K" ,3); //Erase right of cursor
-		abAppend(ab, "\r\n", 3); //Newline
+		else fprintf(fp, "%-14s %10s %10s %10s\n", editorMemName(i), cur, "-", "-"); //walked, no history
 	}
+	editorFormatBytes(cur, total);
+	fprintf(fp, "%-14s %10s\n\n", "total", cur);
+
+	struct editorArena *a = &E.arena;
+	char held[16], mall[16];
+	editorFormatBytes(held, a->reserved);
+	editorFormatBytes(mall, a->mallocequiv);
+	fprintf(fp, "arena: %ld blocks in %s, malloc would hold ~%s\n", a->blocks, held, mall);
+	long rss = editorProcStatus("VmRSS:"), hwm = editorProcStatus("VmHWM:");
+	if (rss >= 0)
+	{
+		editorFormatBytes(cur, rss * 1024);
+		editorFormatBytes(peak, hwm * 1024);
+		editorFormatBytes(held, rss * 1024 > total ? rss * 1024 - total : 0);
+		fprintf(fp, "rss: %s now, %s peak, %s not accounted for above\n", cur, peak, held);
+	}
+	fclose(fp);
+}
+
+void editorMemStart() //KILO_MEMREPORT=FILE
+{
+	char *path = getenv("KILO_MEMREPORT");
+	if (!path || !*path) return;
+	E.mem_dump = path;
+	atexit(editorMemDump);
 }
 
 #pragma endregion
 
-#pragma region //Editor Functions
+#pragma region /*** Profiler ***/
 
-void editorScroll(){
-	//rx settings
-	E.rx = 0;
-	if (E.cy < E.numrows) {
-		E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
-	}
-	//vert scroll
-	if (E.cy < E.rowoff) {
-		E.rowoff = E.cy;
-	}
-	if (E.cy >= E.rowoff + E.screenrows){
-		E.rowoff = E.cy - E.screenrows + 1;
-	}
-	//horizontal scroll
-	if (E.cx < E.coloff){
-		E.coloff = E.rx;
-	}
-	if (E.cx >= E.coloff + E.screencols){
-		E.coloff = E.rx - E.screencols + 1;
-	}
+//Ctrl-P turns on timing of every key and frame and shows it in the message bar (again to hide it,
+//collection keeps going). KILO_PROFILE=FILE has it on from the start and writes the report to FILE
+//on exit. when off every hook is a single test of E.prof.on
+
+long editorProfNow() //monotonic ns
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000L + t.tv_nsec;
 }
 
-void editorInsertChar(int c){
-	//create row if one doesn't exist
-	if (E.cy == E.numrows){
-		editorInsertRow(E.numrows, "", 0);
-	}
-	editorRowInsertChar(&E.row[E.cy], E.cx, c);
-	E.cx++;
+void editorProfAdd(struct profHist *h, long ns) //one sample into a log2 histogram
+{
+	int b = 0;
+	while (b < PROF_BUCKETS - 1 && (1L << (b + 1)) <= ns) b++; //bucket b holds [2^b, 2^(b+1)) ns
+	h->bucket[b]++;
+	h->count++;
+	h->sum += ns;
+	if (ns > h->max) h->max = ns;
 }
 
-void editorInsertNewline(){
-	if (E.cy == E.numrows){
-			editorInsertRow(E.cy, "", 0);
-	} else {
-		erow *row = &E.row[E.cy];
-		editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-		row = &E.row[E.cy];
-		row->size = E.cx;
-		row->chars[row->size] = '\0';
-		editorUpdateRow(row);
+long editorProfPct(struct profHist *h, int p) //upper edge of the bucket holding the p'th percentile, capped at the max seen
+{
+	long want = (h->count * p + 99) / 100, seen = 0;
+	if (!h->count) return 0;
+	for (int b = 0; b < PROF_BUCKETS; b++)
+	{
+		seen += h->bucket[b];
+		if (seen >= want) return (1L << (b + 1)) < h->max ? (1L << (b + 1)) : h->max;
 	}
-	E.cy++;
-	E.cx = 0;
+	return h->max;
 }
 
-void editorDelChar(){
-	//create row if one doesn't exist
-	if (E.cy == E.numrows) return;
-	if (E.cx == 0 && E.cy == 0) {
-		editorRowDelChar(&E.row[E.cy], E.cx);
-		return;
-	}
-	
+void editorFormatNs(char *buf, long ns) //human readable duration
+{
+	if (ns >= 1000000000L) snprintf(buf, 16, "%.2fs", ns / 1e9);
+	else if (ns >= 1000000L) snprintf(buf, 16, "%.1fms", ns / 1e6);
+	else if (ns >= 1000L) snprintf(buf, 16, "%.1fus", ns / 1e3);
+	else snprintf(buf, 16, "%dns", (int)ns);
+}
 
-	erow *row = &E.row[E.cy];
-	if (E.cx > 0) {
-		editorRowDelChar(&E.row[E.cy], E.cx);
-		E.cx--;
-	} else {
-		E.cx = E.row[E.cy - 1].size;
-		editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
-		editorDelRow(E.cy);
-		E.cy--;
+void editorProfToggle() //Ctrl-P
+{
+	if (!E.prof.on) //fresh numbers
+	{
+		const char *dump = E.prof.dump;
+		memset(&E.prof, 0, sizeof(E.prof));
+		E.prof.dump = dump;
+		E.prof.on = 1;
 	}
-
-
-	
+	E.prof.overlay = !E.prof.overlay;
 }
 
-//any issues later on check this
-//https://github.com/snaptoken/kilo-src/blob/status-bar-right/kilo.c
-void editorDrawStatusBar(struct abuf *ab) //status bar curr line/row, filetype, filename etc.
+int editorProfOverlay(char *buf, int len) //the message bar line while the overlay is up
 {
+	char p50[16], p99[16], max[16], per[16];
+	struct profHist *h = &E.prof.lat;
+	editorFormatNs(p50, editorProfPct(h, 50));
+	editorFormatNs(p99, editorProfPct(h, 99));
+	editorFormatNs(max, h->max);
+	editorFormatBytes(per, E.prof.frames ? E.prof.bytes / E.prof.frames : 0);
+	return snprintf(buf, len, "key->paint p50 %s p99 %s max %s | %ld keys %s/frame | %ld render %ld hl",
+		p50, p99, max, h->count, per, E.prof.rows_rendered, E.prof.rows_hl);
+}
 
-	abAppend(ab, "\x1b[7m", 4);
-	char status[80], rstatus[80];//Left and Right corners of status bar
-
-	int len = snprintf(status, sizeof(status), "%.20s - %d, %d| %s | %d %s",
-		E.filename ? E.filename : "[No Name]",//write filename if exist
-		E.cx, //curr col
-		E.cy, //curr row
-		E.syntax ? E.syntax->filetype : "what?",
-		E.dirty, //num changes 
-		E.dirty ? "(Lines Modified)" : "(clean)"); 
-
-	int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d", 
-	E.syntax ? E.syntax->filetype : "no ft", //display filetype if it exists
-	E.cy + 1, //curr visible row
-	E.numrows); //total rows
-
-	if (len > E.screencols) len = E.screencols; //print only vis col
-	abAppend(ab, status, len); //print status
-	while (len < E.screencols) { //if space
-		if (E.screencols - len == rlen) { //Write what's left of visible space
-			abAppend(ab, rstatus, rlen); //print rendered status
-		break;
-		} else {
-			abAppend(ab, " ", 1); //space to pad
-			len++;
+void editorProfDump() //atexit with KILO_PROFILE set
+{
+	FILE *fp = fopen(E.prof.dump, "w");
+	if (!fp) return;
+	struct profHist *hs[] = {&E.prof.lat, &E.prof.key, &E.prof.draw, &E.prof.write};
+	const char *names[] = {"key->paint", "keypress", "draw", "write"};
+	char bytes[16];
+	editorFormatBytes(bytes, E.prof.bytes);
+	fprintf(fp, "kilo profile\n%ld frames, %s written, %ld rows rendered, %ld rows highlighted\n\n",
+		E.prof.frames, bytes, E.prof.rows_rendered, E.prof.rows_hl);
+	fprintf(fp, "%-12s %10s %10s %10s %10s %10s\n", "", "count", "mean", "p50", "p99", "max");
+	for (int i = 0; i < 4; i++)
+	{
+		char mean[16], p50[16], p99[16], max[16];
+		editorFormatNs(mean, hs[i]->count ? hs[i]->sum / hs[i]->count : 0);
+		editorFormatNs(p50, editorProfPct(hs[i], 50));
+		editorFormatNs(p99, editorProfPct(hs[i], 99));
+		editorFormatNs(max, hs[i]->max);
+		fprintf(fp, "%-12s %10ld %10s %10s %10s %10s\n", names[i], hs[i]->count, mean, p50, p99, max);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		fprintf(fp, "\n%s\n", names[i]);
+		for (int b = 0; b < PROF_BUCKETS; b++)
+		{
+			if (!hs[i]->bucket[b]) continue;
+			char lo[16];
+			editorFormatNs(lo, 1L << b);
+			fprintf(fp, "  >= %-8s %10ld\n", lo, hs[i]->bucket[b]);
 		}
 	}
-	
-	abAppend(ab, "\x1b[m", 3); //uninvert colors
-	abAppend(ab, "\r\n", 2); //newline
+	fclose(fp);
 }
 
-void editorDrawMessageBar(struct abuf *ab){
-	abAppend(ab, "\x1b[K", 3);
-
-	int msglen = strlen(E.statusmsg);
-	if (msglen > E.screencols) msglen = E.screencols;
-	if (msglen && time(NULL) - E.statusmsg_time < 5) abAppend(ab, E.statusmsg, msglen);
+void editorProfStart() //KILO_PROFILE=FILE
+{
+	char *path = getenv("KILO_PROFILE");
+	if (!path || !*path) return;
+	E.prof.on = 1;
+	E.prof.dump = path;
+	atexit(editorProfDump);
 }
 
-void editorRefreshScreen() {
-	editorScroll();
-	//init buf
-	struct abuf ab = ABUF_INIT;
-	
-	//?25l hides cursor/doesn't display
-	abAppend(&ab, "\x1b[?25l", 6);
+#pragma endregion
 
+#pragma region /*** Background Highlighting ***/
 
-	// \x1b - escape character
-	// \x1b[ - escape sequence, terminal formatting command
-	// J - Erase In Display, 2 - erase entire screen
-	//abAppend(&ab, "\x1B[2J", 4);
-	
-	//H - cursor position
-	//H Args, height;widthH
-	abAppend(&ab, "\x1b[H", 3);
+//rows that need highlighting past what's cheap to do per keystroke (whole files, comment cascades,
+//replace/undo sweeps) are queued for a worker thread. it copies a batch of rows out under E.lock,
+//highlights them with the lock dropped, then publishes the spans of rows nobody touched meanwhile.
+//the screen keeps drawing whatever spans a row has until then
 
-	editorDrawRows(&ab);
-	if(E.filename) editorDrawStatusBar(&ab);
-	editorDrawMessageBar(&ab);
+#define HL_BATCH 256 //rows copied out per trip through the lock
 
-	//Reposition Cursor cx, cy
-	char buf[32];
-	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1, (E.rx - E.coloff) +1);
-	abAppend(&ab, buf, strlen(buf));
-	
-	//?25h unhides cursor
-	abAppend(&ab, "\x1b[?25h", 6);
-	
-	//write buf out
-	write(STDOUT_FILENO, ab.b, ab.len);
-	abFree(&ab);
-}
+struct hlWork //private state of whoever runs the queue
+{
+	struct editorArena arena; //snapshots and their spans
+	size_t counted; //arena bytes already in E.mem
+	erowdraw row[HL_BATCH];
+	unsigned int ver[HL_BATCH];
+	unsigned char open[HL_BATCH]; //comment left open at the end of row[j]
+};
 
-void editorSetStatusMessage(const char *fmt, ...){
-	va_list ap;
-	va_start(ap,fmt);
-	vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
-	va_end(ap);
-	E.statusmsg_time = time(NULL);
+void editorHlQueue(int at) //hand row at to the worker
+{
+	erow *row = &E.row[at];
+	if (!row->hl_stale)
+	{
+		row->hl_stale = 1;
+		E.hl_nstale++;
+	}
+	if (at < E.hl_from) E.hl_from = at;
+	pthread_cond_signal(&E.hl_cond);
 }
-#pragma endregion
 
-#pragma region /***file i/o ***/
-//Editor Open/Save
-/* Description: User Input: filename File operations: find file with name and open Printing: Copy first line into erow.*/
-void editorOpen(char *filename){
-	free(E.filename); //ensure blank filename to rewrite
-	//tried strdup but it seg faulted
-	E.filename = malloc(strlen(filename)); //allocate new mem to filename
-	memcpy(E.filename, filename, strlen(filename)); //copy filename into editor object
-	editorSelectSyntaxHighlight(); //setup syntax HL for file 
+void editorHlDone(erow *row) //row's spans are current
+{
+	if (!row->hl_stale) return;
+	row->hl_stale = 0;
+	E.hl_nstale--;
+}
 
-	FILE *fp = fopen(filename, "r"); //attempts to open the passed in filename
-	if (!fp) die("fopen"); //if filename doesn't exist than throw error
+void editorHlPass(struct hlWork *w) //work the queue down to nothing. called with E.lock held, drops it while highlighting
+{
+	int i = E.hl_from;
+	E.hl_from = INT_MAX;
+	while (i < E.numrows)
+	{
+		if (E.hl_from <= i) //something at or above us was queued while we were out, go back for it
+		{
+			i = E.hl_from;
+			E.hl_from = INT_MAX;
+		}
+		if (E.hl_nstale == 0) break;
+		while (i < E.numrows && !E.row[i].hl_stale) i++; //next row that asked for it
+		if (i >= E.numrows) break;
+
+		//snapshot a batch
+		struct editorSyntax *syntax = E.syntax;
+		int in_comment = i > 0 && E.row[i - 1].hl_open_comment;
+		int n;
+		for (n = 0; n < HL_BATCH && i + n < E.numrows; n++)
+		{
+			erowdraw *src = &E.rowdraw[i + n], *dst = &w->row[n];
+			if (src->rsize + 1 > dst->rcap) dst->render = arenaRealloc(&w->arena, dst->render, dst->rcap, src->rsize + 1, &dst->rcap);
+			memcpy(dst->render, src->render, src->rsize + 1);
+			dst->rsize = src->rsize;
+			w->ver[n] = E.row[i + n].ver;
+		}
 
-	char *line = NULL; //line holder var
-	size_t linecap = 0; //max amount to readin
-	ssize_t linelen; //length read into line
-	
-	while((linelen = getline(&line, &linecap, fp)) != -1){
-		//decrement till linelen only includes characters before end of line
-		while(linelen > 0 //make sure line has content
-		&& (line[linelen - 1] == '\n' //curchar not a newline
-		|| line[linelen -1] == '\r')) //curchar not a return 
+		pthread_mutex_unlock(&E.lock);
+		for (int j = 0; j < n; j++)
 		{
-			linelen--; //decrement index till not \n\r
+			in_comment = w->open[j] = editorHighlightRowIn(&w->row[j], 0, in_comment, syntax, &w->arena);
 		}
-		editorInsertRow(E.numrows, line, linelen); //insert written row into numrows object
+		pthread_mutex_lock(&E.lock);
+		memCount(MEM_HLWORK, (long)w->arena.reserved - (long)w->counted); //its arena only grows
+		w->counted = w->arena.reserved;
+
+		//publish in order until a row that changed under us. a row whose open comment state flips
+		//flags the one below, so the cascade survives rows being inserted or deleted meanwhile
+		int j;
+		for (j = 0; j < n && i + j < E.hl_from && i + j < E.numrows; j++)
+		{
+			erow *row = &E.row[i + j];
+			erowdraw *d = &E.rowdraw[i + j], *r = &w->row[j];
+			if (row->ver != w->ver[j]) break; //edited (and highlighted) on the main thread
+			int bytes = sizeof(hlspan) * r->nhl;
+			if (bytes > d->hlcap) d->hl = arenaRealloc(&E.arena, d->hl, d->hlcap, bytes, &d->hlcap);
+			if (bytes) memcpy(d->hl, r->hl, bytes);
+			d->nhl = r->nhl;
+			editorHlDone(row);
+			editorBracketRow(row);
+			if (row->hl_open_comment != w->open[j] && i + j + 1 < E.numrows && !E.row[i + j + 1].hl_stale)
+			{
+				E.row[i + j + 1].hl_stale = 1;
+				E.hl_nstale++;
+			}
+			row->hl_open_comment = w->open[j];
+			int line = E.fold.ntop ? editorFoldLine(i + j) - editorFoldLine(E.rowoff) : i + j - E.rowoff; //closed folds take one line
+			if (line >= 0 && line < E.screenrows) E.hl_repaint = 1;
+		}
+		if (E.prof.on) E.prof.rows_hl += j;
+		i += j;
 	}
+}
 
-	free(line); //free line holding var
-	fclose(fp); //close file
-	E.dirty = 0; //set dirty flags to 0 since file just opened
+void *editorHlWorker(void *arg) //worker thread, sleeps until rows are queued
+{
+	struct hlWork *w = arg;
+	pthread_mutex_lock(&E.lock);
+	for (;;)
+	{
+		while (E.hl_from == INT_MAX) pthread_cond_wait(&E.hl_cond, &E.lock);
+		editorHlPass(w);
+	}
+	return NULL;
 }
 
-void editorSave(){
-	if (E.filename == NULL) //If filename null go here
-	{		
-		if ((E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL)) == NULL) //prompt them to enter filename 
-		{
-			editorSetStatusMessage("Save Aborted"); //no filename so no save
-			return;
-		}
-		editorSelectSyntaxHighlight();
-	} 
+void editorHlStart() //spin up the worker, from here on the main thread only lets go of E.lock to wait for input
+{
+	static struct hlWork w;
+	pthread_t tid;
+	pthread_mutex_lock(&E.lock);
+	if (pthread_create(&tid, NULL, editorHlWorker, &w) == 0) pthread_detach(tid);
+}
 
-	int fd; 
-	int len;
-	char *buf = editorRowsToString(&len); //big buf to store all content from editor
+void editorHlFlush() //run the queue to the end on this thread (E.lock held)
+{
+	static struct hlWork w;
+	while (E.hl_nstale) //rows the worker has out are still stale, go over them again rather than wait
+	{
+		if (E.hl_from == INT_MAX) E.hl_from = 0;
+		editorHlPass(&w);
+	}
+}
 
-	if ((fd = open(E.filename, O_CREAT | O_RDWR,  0644)) == -1) goto esEnd; //open file, create if doesn't exist
-	if (ftruncate(fd, len) == -1) goto esEnd; //truncate to length of content needed to write
-	if (write(fd, buf, len) != len) goto esEnd; //write all content from buf onto file
+#pragma endregion
+
+#pragma region /*** Undo ***/
+
+void editorUndoPush(int type, int row, int col, int c, char *text, int len, int cap) //record a primitive edit, takes ownership of text (an arena block of cap bytes)
+{
+	if (E.undo_suspended) //loading a file or undoing, nothing to record
+	{
+		arenaFree(&E.arena, text, cap);
+		return;
+	}
+	if (E.undolen == E.undocap) //grow log geometrically
+	{
+		int old = E.undocap;
+		E.undocap = E.undocap ? E.undocap * 2 : 64;
+		E.undo = memRealloc(MEM_UNDO, E.undo, sizeof(editorUndoOp) * old, sizeof(editorUndoOp) * E.undocap);
+	}
+	editorUndoOp *op = &E.undo[E.undolen++];
+	op->type = type;
+	op->group = E.undo_group;
+	op->row = row;
+	op->col = col;
+	op->c = c;
+	op->text = text;
+	op->len = len;
+	op->cap = cap;
+}
+
+#pragma endregion
+
+#pragma region //Row Operations
+
+char *editorRowsToString(int *buflen) //Editor representation -> Buf
+{
+	int totlen = 0; //buf length var
+	int i; //loop counter
+	for (i = 0; i < E.numrows; i++) totlen += E.row[i].size + 1; //iterate through all rows, sum length of all rows
+	*buflen = totlen; //set buf length to totlen
+
+	char *buf = malloc(totlen); //assign buf enough memory to hold all row data
+	char *p = buf; //local var to manipulate buf which will be passed up to parent
+
+	for (i = 0; i < E.numrows; i++) //iterate through all rows
+	{
+		memcpy(p, E.row[i].chars, E.row[i].size); //copy curr row to buf
+		p += E.row[i].size; //increment p index to end of curr row/line
+		*p = '\n'; //append '\n' to seperate written lines
+		p++; //increment p to nexxt free index.
+	}
+	return buf; //return buffer containing all informatoin held by editor
+}
+
+erowdraw *editorRowDraw(erow *row) //render side of a row in E.row
+{
+	return &E.rowdraw[row - E.row];
+}
+
+void editorRowFixup(erow *row) //re-aim the pointers a row has into itself after E.row moved
+{
+	erowdraw *d = editorRowDraw(row);
+	if (!row->cap) row->chars = row->u.inl;
+	if (!d->rcap) d->render = row->chars;
+}
+
+void editorRowReserve(erow *row, int need) //make sure chars can hold need bytes (incl '\0'), doubling so appends are amortized O(1)
+{
+	int have = row->cap ? row->cap : KILO_ROW_INLINE;
+	if (need <= have) return;
+	int cap = have;
+	while (cap < need) cap *= 2;
+	if (!row->cap) //outgrew the inline slot, move out and start checkpoint state in its place
+	{
+		char *chars = arenaAlloc(&E.arena, cap, &row->cap);
+		memcpy(chars, row->u.inl, row->size + 1);
+		row->u.cp = NULL;
+		row->chars = chars;
+	}
+	else row->chars = arenaRealloc(&E.arena, row->chars, row->cap, cap, &row->cap);
+	editorRowFixup(row);
+}
+
+void editorRowSetChars(erow *row, const char *s, int len) //replace the row's text with a copy of s, not rendered yet
+{
+	if (row->cap) arenaFree(&E.arena, row->chars, row->cap);
+	if (len < KILO_ROW_INLINE)
+	{
+		if (row->cap && row->u.cp) arenaFree(&E.arena, row->u.cp, sizeof(struct erowcps) + sizeof(erowcp) * row->u.cp->rxcpcap); //union switches over to text
+		memcpy(row->u.inl, s, len);
+		row->u.inl[len] = '\0';
+		row->cap = 0;
+	}
+	else
+	{
+		if (!row->cap) row->u.cp = NULL;
+		row->chars = editorArenaDup(s, len, &row->cap);
+	}
+	row->size = len;
+	editorRowFixup(row);
+}
+
+char *editorRowTakeChars(erow *row, int *cap) //detach the row's text as an arena block (inline text gets copied), row needs new text after
+{
+	char *chars = row->chars;
+	*cap = row->cap;
+	if (!row->cap) chars = editorArenaDup(row->u.inl, row->size, cap);
+	else row->chars = NULL; //so editorRowSetChars/editorFreeRow don't free it
+	return chars;
+}
+
+int editorRowStep(erow *r, int cx, int *rx, int *ri) //advance past the char at cx, moving rx (screen) and ri (render) along. returns next cx
+{
+	unsigned char c = r->chars[cx];
+	if (c == '\t') //tabs render as spaces up to the next stop
+	{
+		int next = *rx + KILO_TAB_STOP - (*rx % KILO_TAB_STOP);
+		*ri += next - *rx;
+		*rx = next;
+		return cx + 1;
+	}
+	if (c < 0x80) //ascii, one byte one column
+	{
+		(*rx)++;
+		(*ri)++;
+		return cx + 1;
+	}
+	int cp;
+	int n = editorUtf8Decode(&r->chars[cx], r->size - cx, &cp);
+	*rx += editorCharWidth(cp);
+	*ri += n;
+	return cx + n;
+}
+
+erowcp editorRowCheckpoint(erow *r, int by, int target) //last checkpoint at or before target, by = offsetof the field to search
+{
+	erowcp start = {0, 0, 0};
+	if (!r->cap || !r->u.cp) return start; //too short for checkpoints
+	int lo = 1, hi = r->u.cp->ncp - 1; //rxcp[0] is always the row start
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		int v = *(int *)((char *)&r->u.cp->rxcp[mid] + by);
+		if (v <= target)
+		{
+			start = r->u.cp->rxcp[mid];
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return start;
+}
+
+int editorRowWalk(erow *r, int by, int target, int *rx, int *ri) //find the char at cx / covering rx / covering ri (by = offsetof field) from the nearest checkpoint. returns its cx
+{
+	erowcp p = editorRowCheckpoint(r, by, target);
+	while (p.cx < r->size)
+	{
+		erowcp next = p;
+		next.cx = editorRowStep(r, p.cx, &next.rx, &next.ri);
+		if (*(int *)((char *)&next + by) > target) break; //char at p covers target
+		p = next;
+	}
+	if (rx) *rx = p.rx;
+	if (ri) *ri = p.ri;
+	return p.cx;
+}
+
+struct erowcps *editorRowCheckpoints(erow *row, int n) //make room for n checkpoints, keeping the ones there
+{
+	struct erowcps *cp = row->u.cp;
+	int have = cp ? cp->rxcpcap : 0;
+	if (n <= have) return cp;
+	int bytes;
+	cp = arenaRealloc(&E.arena, cp, cp ? sizeof(struct erowcps) + sizeof(erowcp) * have : 0, sizeof(struct erowcps) + sizeof(erowcp) * n, &bytes);
+	if (!have) cp->ncp = 0;
+	cp->rxcpcap = (bytes - sizeof(struct erowcps)) / sizeof(erowcp);
+	return row->u.cp = cp;
+}
+
+int editorRenderRowFrom(erow *row, int cx) //rebuilds 'rendered' row from chars[cx] on, the part before is unchanged. returns render pos where it restarted
+{
+	erowdraw *d = editorRowDraw(row);
+	if (cx > row->size) cx = row->size;
+	if (E.prof.on) E.prof.rows_rendered++;
+
+	//restart at a checkpoint before cx so utf-8 is decoded from a known char boundary. a sequence
+	//decoded before it may have peeked up to 3 bytes ahead, so it has to sit 3 bytes clear of the edit
+	struct erowcps *cp = row->cap ? row->u.cp : NULL; //inline and short rows have none
+	int k = cx / KILO_RX_STEP;
+	if (!cp || k >= cp->ncp) k = cp ? cp->ncp - 1 : 0;
+	while (k > 0 && cp->rxcp[k].cx + 3 > cx) k--;
+	erowcp p = {0, 0, 0};
+	if (k > 0) p = cp->rxcp[k];
+	else k = 0;
+	int i = p.cx; //chars index
+	int rx = p.rx; //screen column
+	int idx = p.ri; //render index
+	int start = idx;
+	row->ver = ++E.hlver;
+
+	if (row->utf8at == -1 || row->utf8at >= i) //prefix before i is known ascii, look at the rest
+	{
+		int f = editorFirstHighByte(&row->chars[i], row->size - i);
+		row->utf8at = (f == -1) ? -1 : i + f;
+	}
+
+	int ncp = row->size / KILO_RX_STEP + 1; //checkpoints needed, only ever > 1 for rows in the arena
+	if (ncp > 1 && (!cp || ncp > cp->rxcpcap))
+	{
+		int have = cp ? cp->rxcpcap : 0;
+		cp = editorRowCheckpoints(row, ncp > have * 2 ? ncp : have * 2);
+	}
+
+  	int tabs = 0; //tab counter
+	for (int j = i; j < row->size; j++) //loop through remaining chars in row
+	if (row->chars[j] == '\t') tabs++; //count tabs in row
+	int shared = tabs == 0 && (!d->rcap || !memchr(row->chars, '\t', i)); //nothing to expand, render is just chars
+	int need = idx + (row->size - i) + tabs*(KILO_TAB_STOP - 1) + 1; //'\0', tabs (8), chars (1)ea.
+	if (shared)
+	{
+		if (d->rcap) arenaFree(&E.arena, d->render, d->rcap);
+		d->rcap = 0;
+		d->render = row->chars;
+	}
+	else if (!d->rcap) //was sharing chars, the prefix up to idx is the same so copy it out
+	{
+		char *render = arenaAlloc(&E.arena, need, &d->rcap);
+		memcpy(render, row->chars, idx);
+		d->render = render;
+	}
+	else if (need > d->rcap) //grow frs
+	{
+		d->render = arenaRealloc(&E.arena, d->render, d->rcap, need > d->rcap * 2 ? need : d->rcap * 2, &d->rcap);
+	}
+	while (i < row->size) //iterate through remaining chars in row
+	{
+		while (ncp > 1 && k * KILO_RX_STEP <= i) //checkpoint every char boundary crossing a step
+		{
+			cp->rxcp[k].cx = i;
+			cp->rxcp[k].rx = rx;
+			cp->rxcp[k].ri = idx;
+			k++;
+		}
+		int ri = idx;
+		int next = editorRowStep(row, i, &rx, &idx);
+		if (shared) {} //already there
+		else if (row->chars[i] == '\t') memset(&d->render[ri], ' ', idx - ri); //'render' spaces up to the tab stop
+		else memcpy(&d->render[ri], &row->chars[i], next - i); //'render' char as is, utf-8 stays multibyte
+		i = next;
+	}
+	for (; ncp > 1 && k < ncp; k++) //checkpoints at the very end of the row
+	{
+		cp->rxcp[k].cx = i;
+		cp->rxcp[k].rx = rx;
+		cp->rxcp[k].ri = idx;
+	}
+	if (cp) cp->ncp = (ncp > 1) ? ncp : 0;
+	if (!shared) d->render[idx] = '\0';//terminate 'rendered' string
+	d->rsize = idx; //'render' size = last 'render' index
+	if (E.wrap && E.wrap_width) editorWrapRow(row); //else counted with the rest
+	return start;
+}
+
+int editorRowCheckpointIdx(erow *r, int cx) //first checkpoint at or past cx, ncp = none. r has checkpoints
+{
+	int lo = 0, hi = r->u.cp->ncp;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (r->u.cp->rxcp[mid].cx < cx) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+//an edit in the middle of a long row only moves what's after it: the chars, their render and the
+//checkpoints past it keep their columns give or take the edit's width. the first tab after it may end
+//up wider or narrower, but it still ends on a stop, so past it everything moves by whole stops and the
+//later tabs keep their widths. so the walk goes from the checkpoint before the edit to the first one
+//after it, that one tab is re-rendered, and the rest of the render and the checkpoints are moved along
+//instead of walked. typing in a 1MB
+//line costs a couple of checkpoint steps plus a memmove. the walked stretch gets checkpoints of its own
+//in the slots the old ones leave, more are opened up when they run out, so they can drift off the
+//KILO_RX_STEP grid but never get further apart than 2 steps. editorRenderRowFrom puts them back on it
+
+int editorRenderRowShift(erow *row, int cx, int n) //n bytes went in at cx (n < 0: -n came out), render and checkpoints are still the old row's. returns render pos where it restarted, -1 = the tail didn't just move, nothing touched
+{
+	erowdraw *d = editorRowDraw(row);
+	struct erowcps *cp = row->cap ? row->u.cp : NULL;
+	if (!cp || cp->ncp < 2) return -1; //short rows are walked whole, that's cheap
+	if (!d->rcap && n > 0 && memchr(&row->chars[cx], '\t', n)) return -1; //render stops sharing chars
+
+	//walk the new text from the last checkpoint 3 clear of the edit (see editorRenderRowFrom) until
+	//it lands on the char the first old checkpoint past the edit was on
+	int j = editorRowCheckpointIdx(row, cx + (n < 0 ? -n : 0));
+	if (j == cp->ncp) return -1;
+	int r = editorRowCheckpointIdx(row, cx - 2) - 1; //last one with cx + 3 <= edit
+	if (r < 0) r = 0;
+	erowcp old = cp->rxcp[j], from = cp->rxcp[r], p = from;
+	int target = old.cx + n;
+	while (p.cx < target) p.cx = editorRowStep(row, p.cx, &p.rx, &p.ri);
+	if (p.cx != target) return -1; //the edit left half a utf-8 char that swallowed the boundary
+	int drx = p.rx - old.rx, dri = p.ri - old.ri;
+	int t = -1, tri = 0, w = 0, w2 = 0; //the first tab past the edit: where it is, its render pos and old/new width
+	if (drx % KILO_TAB_STOP && d->rcap)
+	{
+		char *tab = memchr(&row->chars[target], '\t', row->size - target);
+		if (tab)
+		{
+			t = tab - row->chars;
+			erowcp c = cp->rxcp[editorRowCheckpointIdx(row, t - n + 1) - 1]; //old checkpoint at or before it, moved
+			c.cx += n;
+			c.rx += drx;
+			c.ri += dri;
+			while (c.cx < t) c.cx = editorRowStep(row, c.cx, &c.rx, &c.ri);
+			if (c.cx != t) return -1;
+			tri = c.ri;
+			w = KILO_TAB_STOP - (c.rx - drx) % KILO_TAB_STOP;
+			w2 = KILO_TAB_STOP - c.rx % KILO_TAB_STOP;
+		}
+	}
+
+	if (E.prof.on) E.prof.rows_rendered++;
+	row->ver = ++E.hlver;
+	if (row->utf8at >= cx || row->utf8at == -1) //the edit may have brought the first high byte in or taken it out
+	{
+		int f = editorFirstHighByte(&row->chars[cx], n > 0 ? n : 0);
+		if (f != -1) row->utf8at = cx + f;
+		else if (row->utf8at != -1 && row->utf8at >= cx - n) row->utf8at += n; //moved along with the tail
+		else if (row->utf8at != -1) //it was in what came out
+		{
+			f = editorFirstHighByte(&row->chars[cx], row->size - cx);
+			row->utf8at = f == -1 ? -1 : cx + f;
+		}
+	}
+	if (d->rcap) //render tail over by dri (dri + w2 - w past the tab), then the walked stretch written in front of it
+	{
+		int end = d->rsize + dri + w2 - w;
+		if (end + 1 > d->rcap) d->render = arenaRealloc(&E.arena, d->render, d->rcap, (end + 1) * 2, &d->rcap);
+		if (t < 0) memmove(&d->render[old.ri + dri], &d->render[old.ri], d->rsize - old.ri + 1);
+		else
+		{
+			int otri = tri - dri;
+			if (dri > w) memmove(&d->render[tri + w2], &d->render[otri + w], d->rsize - otri - w + 1); //the part up to the tab would land on the part after it
+			memmove(&d->render[old.ri + dri], &d->render[old.ri], otri - old.ri);
+			if (dri <= w) memmove(&d->render[tri + w2], &d->render[otri + w], d->rsize - otri - w + 1);
+			memset(&d->render[tri], ' ', w2);
+		}
+		d->rsize = end;
+	}
+	else d->rsize += dri;
+
+	int want = (target - from.cx) / KILO_RX_STEP; //checkpoints inside the walked stretch
+	if (want > j - r - 1) //open up slots before j
+	{
+		int more = want - (j - r - 1);
+		if (cp->ncp + more > cp->rxcpcap) cp = editorRowCheckpoints(row, (cp->ncp + more) * 2);
+		memmove(&cp->rxcp[j + more], &cp->rxcp[j], sizeof(erowcp) * (cp->ncp - j));
+		j += more;
+		cp->ncp += more;
+	}
+	int q = r + 1, last = from.cx;
+	for (p = from; p.cx < target; )
+	{
+		if (p.cx - last >= KILO_RX_STEP && q < j)
+		{
+			cp->rxcp[q++] = p;
+			last = p.cx;
+		}
+		int ri = p.ri;
+		int next = editorRowStep(row, p.cx, &p.rx, &p.ri);
+		if (!d->rcap) {} //shares chars
+		else if (row->chars[p.cx] == '\t') memset(&d->render[ri], ' ', p.ri - ri);
+		else memcpy(&d->render[ri], &row->chars[p.cx], next - p.cx);
+		p.cx = next;
+	}
+	for (; q < j; q++) cp->rxcp[q] = p; //spare slots sit on the landing spot
+	for (int k = j; k < cp->ncp; k++)
+	{
+		int past = t >= 0 && cp->rxcp[k].cx > t - n; //after the tab
+		cp->rxcp[k].cx += n;
+		cp->rxcp[k].rx += drx + (past ? w2 - w : 0);
+		cp->rxcp[k].ri += dri + (past ? w2 - w : 0);
+	}
+	if (E.wrap && E.wrap_width) editorWrapRow(row);
+	return from.ri;
+}
+
+void editorRenderRow(erow *row) //rebuilds 'rendered' row from chars, no highlighting
+{
+	editorRenderRowFrom(row, 0);
+}
+
+void editorUpdateRowFrom(erow *row, int cx) //re-render and re-highlight only what's after an edit at cx
+{
+	int rx = editorRenderRowFrom(row, cx);
+	editorUpdateSyntaxFrom(row, rx);
+}
+
+void editorUpdateRowEdit(erow *row, int cx, int n) //editorUpdateRowFrom for n bytes in at cx (n < 0: out), the tail is moved rather than walked when it can be
+{
+	int rx = editorRenderRowShift(row, cx, n);
+	if (rx < 0) rx = editorRenderRowFrom(row, cx);
+	editorUpdateSyntaxFrom(row, rx);
+}
+
+void editorUpdateRow(erow *row) //updates 'rendered' row and highlight scheme
+{
+	editorUpdateRowFrom(row, 0);
+}
+
+void editorInsertRows(int at, char **s, const int *len, int n) //create and insert n erows, the ones below shift once
+{
+	if (at < 0 || at > E.numrows || n <= 0) return; //return if currRow outside allocated row range [0-numrows]
+
+	if (E.numrows + n > E.rowcap) //give Editor row pointer space to point to new erows, doubling
+	{
+		erow *old = E.row;
+		int oldcap = E.rowcap;
+		if (!E.rowcap) E.rowcap = 64;
+		while (E.rowcap < E.numrows + n) E.rowcap *= 2;
+		E.row = memRealloc(MEM_ROWS, E.row, sizeof(erow) * oldcap, sizeof(erow) * E.rowcap);
+		E.rowdraw = memRealloc(MEM_ROWS, E.rowdraw, sizeof(erowdraw) * oldcap, sizeof(erowdraw) * E.rowcap);
+		if (E.row != old) for (int j = 0; j < E.numrows; j++) editorRowFixup(&E.row[j]);
+	}
+	memmove(&E.row[at + n], &E.row[at], sizeof(erow) * (E.numrows - at)); //open up gap @ at for new erows
+	memmove(&E.rowdraw[at + n], &E.rowdraw[at], sizeof(erowdraw) * (E.numrows - at));
+	editorWrapShift(at, n);
+	editorFoldShift(at, n);
+	editorBracketShift(at, n);
+	for (int j = at + n; j < E.numrows + n; j++) if (!E.row[j].cap) editorRowFixup(&E.row[j]); //inline text moved with the row
+
+	for (int k = 0; k < n; k++)
+	{
+		erow *row = &E.row[at + k];
+		erowdraw *d = &E.rowdraw[at + k];
+		row->cap = 0; //starts out inline
+		d->rcap = 0;
+		d->rsize = 0; //set new rows render size
+		d->hl = NULL; //no stylization applied to row yet
+		d->nhl = 0;
+		d->hlcap = 0;
+		row->utf8at = -1;
+		editorRowSetChars(row, s[k], len[k]); //copy string S to is.
+		row->hl_open_comment = at > 0 && E.row[at - 1].hl_open_comment; //what the row below saw until now, so a change shows up
+		row->hl_stale = 0;
+	}
+
+	E.numrows += n; //trakc new num of rows
+	for (int k = 0; k < n; k++)
+	{
+		editorUpdateRow(&E.row[at + k]); //updates the row
+		E.dirty++; //track num of edits made
+		editorUndoPush(UNDO_INSERT_ROW, at + k, 0, 0, NULL, 0, 0);
+	}
+}
+
+void editorInsertRow(int at, char *s, size_t len) //create and insert erow
+{
+	int n = len;
+	editorInsertRows(at, &s, &n, 1);
+}
+
+void editorFreeRow(erow *row) //free row struct/object
+{
+	erowdraw *d = editorRowDraw(row);
+	if (d->rcap) arenaFree(&E.arena, d->render, d->rcap); //free 'visible' format string representation or FRS
+	arenaFree(&E.arena, d->hl, d->hlcap); //free styling spans
+	if (!row->cap) return; //text was inline
+	arenaFree(&E.arena, row->chars, row->cap); //free 'internal' string representation isr.
+	if (row->u.cp) arenaFree(&E.arena, row->u.cp, sizeof(struct erowcps) + sizeof(erowcp) * row->u.cp->rxcpcap); //free checkpoints
+}
+
+void editorFreeRows() //drop the whole buffer so another file can be loaded
+{
+	arenaRelease(&E.arena); //every row's text, render, hl and the undo log's text at once
+	memFree(MEM_ROWS, E.row, sizeof(erow) * E.rowcap);
+	memFree(MEM_ROWS, E.rowdraw, sizeof(erowdraw) * E.rowcap);
+	E.row = NULL;
+	E.rowdraw = NULL;
+	E.numrows = 0;
+	E.rowcap = 0;
+	E.hl_from = INT_MAX; //nothing left to highlight
+	E.hl_nstale = 0;
+	E.cx = E.cy = E.rx = E.farx = 0;
+	E.rowoff = E.coloff = E.wrapoff = 0;
+	E.wrap_width = 0; //wrap stays on, the new rows are counted at the next draw
+	E.fold.n = E.fold.ntop = 0;
+	E.fold.shown_from = E.fold.shown_end = 0;
+	editorBracketFree(); //built again when it's next needed
+	E.dirty = 0;
+	E.undolen = 0; //undo ops point at rows that are gone
+	memFree(MEM_DISKHASH, E.disk_hash, sizeof(uint64_t) * E.disk_lines);
+	E.disk_hash = NULL;
+	E.disk_lines = 0;
+	if (E.hex) munmap(E.hex, E.hex_size); //hex view's "rows"
+	E.hex = NULL;
+	E.hex_size = 0;
+}
+
+void editorDelRows(int at, int n){ //n rows from at, the ones below shift once
+	if (at < 0 || at >= E.numrows || n <= 0) return;
+	if (n > E.numrows - at) n = E.numrows - at;
+	for (int k = 0; k < n; k++)
+	{
+		erow *row = &E.row[at + k];
+		if (!E.undo_suspended) //hand the text to the undo log instead of freeing it, as if deleted one at a time at at
+		{
+			int cap;
+			char *chars = editorRowTakeChars(row, &cap);
+			editorUndoPush(UNDO_DELETE_ROW, at, 0, 0, chars, row->size, cap);
+		}
+		editorHlDone(row);
+		editorFreeRow(row);
+	}
+	memmove(&E.row[at], &E.row[at + n], sizeof(erow) * (E.numrows - at - n));
+	memmove(&E.rowdraw[at], &E.rowdraw[at + n], sizeof(erowdraw) * (E.numrows - at - n));
+	editorWrapShift(at, -n);
+	editorFoldShift(at, -n);
+	editorBracketShift(at, -n);
+	for (int j = at; j < E.numrows - n; j++) if (!E.row[j].cap) editorRowFixup(&E.row[j]); //inline text moved with the row
+	E.numrows -= n;
+	E.dirty += n;
+	editorFoldRewrap(); //rows a fold that lost its header was hiding
+	if (at < E.numrows) editorHlQueue(at); //its open comment state comes from a different row now
+}
+
+void editorDelRow(int at){
+	editorDelRows(at, 1);
+}
+
+void editorRowInsertChars(erow *row, int at, const char *s, int n){ //insert n bytes at 'at'
+	if (at < 0 || at > row->size) at = row->size;
+	editorUndoPush(UNDO_INSERT_CHAR, row - E.row, at, 0, NULL, n, 0);
+	editorRowReserve(row, row->size + n + 1);
+	memmove(&row->chars[at + n], &row->chars[at], row->size - at + 1);
+	memcpy(&row->chars[at], s, n);
+	row->size += n;
+	editorUpdateRowEdit(row, at, n);
+	E.dirty++;
+}
+
+void editorRowInsertChar(erow *row, int at, int c){
+	char ch = c;
+	editorRowInsertChars(row, at, &ch, 1);
+}
+
+void editorRowAppendString(erow *row, char *s, size_t len){
+	editorUndoPush(UNDO_APPEND_STRING, row - E.row, row->size, 0, NULL, 0, 0);
+	int at = row->size;
+	editorRowReserve(row, row->size + len + 1);
+	memcpy(&row->chars[row->size], s, len); //erase curr null char
+	row->size += len;
+	row->chars[row->size] = '\0';
+	editorUpdateRowFrom(row, at);
+	E.dirty++;
+}
+
+void editorRowDelChars(erow *row, int at, int n){ //delete n bytes at 'at'
+	if (at < 0 || at >= row->size || n <= 0) return;
+	if (at + n > row->size) n = row->size - at;
+	if (n == 1) editorUndoPush(UNDO_DELETE_CHAR, row - E.row, at, (unsigned char)row->chars[at], NULL, 1, 0);
+	else if (E.undo_suspended) editorUndoPush(UNDO_DELETE_CHAR, row - E.row, at, 0, NULL, n, 0);
+	else
+	{
+		int cap;
+		char *text = editorArenaDup(&row->chars[at], n, &cap);
+		editorUndoPush(UNDO_DELETE_CHAR, row - E.row, at, 0, text, n, cap);
+	}
+	memmove(&row->chars[at], &row->chars[at + n], row->size - at - n + 1);
+	row->size -= n;
+	editorUpdateRowEdit(row, at, -n);
+	E.dirty++;
+}
+
+void editorRowDelChar(erow *row, int at){
+	if (at < 0 || at > row->size) return;
+	if (at == row->size) at--; //deleting at eol drops the last char
+	if (at < 0) return; //empty row
+	editorRowDelChars(row, at, 1);
+}
+
+int editorRowNextCluster(erow *row, int cx) //cx of the char after the one at cx, combining marks and zwj sequences stay with their base
+{
+	if (cx >= row->size) return row->size;
+	if ((unsigned char)row->chars[cx] < 0x80 && (unsigned char)row->chars[cx + 1] < 0x80) return cx + 1; //ascii followed by ascii (or '\0')
+
+	int cp;
+	cx += editorUtf8Decode(&row->chars[cx], row->size - cx, &cp);
+	int joined = (cp == UTF8_ZWJ);
+	while (cx < row->size)
+	{
+		int n = editorUtf8Decode(&row->chars[cx], row->size - cx, &cp);
+		if (!joined && (cp < 0x300 || editorCharWidth(cp) != 0)) break; //next base char
+		joined = (cp == UTF8_ZWJ);
+		cx += n;
+	}
+	return cx;
+}
+
+int editorRowPrevStart(erow *row, int cx) //start of the codepoint before cx
+{
+	int p = cx - 1;
+	while (p > 0 && cx - p < 4 && ((unsigned char)row->chars[p] & 0xC0) == 0x80) p--; //back over continuation bytes
+	int cp;
+	if (p + editorUtf8Decode(&row->chars[p], row->size - p, &cp) != cx) p = cx - 1; //wasn't one sequence, step a byte
+	return p;
+}
+
+int editorRowPrevCluster(erow *row, int cx) //cx of the char before cx, same grouping as editorRowNextCluster
+{
+	if (cx <= 0) return 0;
+	if ((unsigned char)row->chars[cx - 1] < 0x80 && (cx < 2 || (unsigned char)row->chars[cx - 2] < 0x80)) return cx - 1; //ascii
+
+	int s = editorRowPrevStart(row, cx);
+	while (s > 0)
+	{
+		int cp, pcp;
+		editorUtf8Decode(&row->chars[s], row->size - s, &cp);
+		int t = editorRowPrevStart(row, s);
+		editorUtf8Decode(&row->chars[t], row->size - t, &pcp);
+		if ((cp >= 0x300 && editorCharWidth(cp) == 0) || pcp == UTF8_ZWJ) s = t; //s hangs off the char before it
+		else break;
+	}
+	return s;
+}
+
+int editorRowCxToRx(erow *r, int cx){
+	int rx = 0;
+	
+	if (cx == 0) {
+		rx += (r->chars[0] == '\t') ? ((KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP)) + 1 : 0;
+		return rx;
+	} 
+
+	if (cx > r->size) cx = r->size;
+	if (editorRowDraw(r)->rsize == r->size && r->utf8at == -1) return cx; //nothing expanded so columns are chars
+
+	editorRowWalk(r, offsetof(erowcp, cx), cx, &rx, NULL);
+	return rx;
+}
+
+int editorRowRXtoCX(erow *r, int rx){
+	if (editorRowDraw(r)->rsize == r->size && r->utf8at == -1) return (rx < r->size) ? rx : r->size; //nothing expanded so columns are chars
+	return editorRowWalk(r, offsetof(erowcp, rx), rx, NULL, NULL);
+}
+
+int editorRowCxToRi(erow *r, int cx) //render offset of cx
+{
+	if (cx > r->size) cx = r->size;
+	if (editorRowDraw(r)->rsize == r->size) return cx;
+	int ri;
+	editorRowWalk(r, offsetof(erowcp, cx), cx, NULL, &ri);
+	return ri;
+}
+
+int editorRowRiToCx(erow *r, int ri) //cx of the char covering render offset ri
+{
+	if (editorRowDraw(r)->rsize == r->size && r->utf8at == -1) return (ri < r->size) ? ri : r->size;
+	return editorRowWalk(r, offsetof(erowcp, ri), ri, NULL, NULL);
+}
+
+cell *editorCell(int y, int x) //position in the frame being composed
+{
+	return &E.screen[y * E.termcols + x];
+}
+
+void editorPutCell(int y, int x, const char *s, int n, int color, int inverse) //one char, n = 0 marks the right half of a wide one
+{
+	cell *c = editorCell(y, x);
+	memset(c, 0, sizeof(*c));
+	memcpy(c->c, s, n);
+	c->n = n;
+	c->color = color;
+	c->inverse = inverse;
+}
+
+void editorPutText(int y, int x, int width, const char *s, int len, int inverse) //plain text into a screen row, cut at width columns
+{
+	for (int j = 0, n, w, cp; j < len && width > 0; j += n, x += w, width -= w)
+	{
+		n = editorUtf8Decode(&s[j], len - j, &cp);
+		w = editorCharWidth(cp);
+		if (w > width) break;
+		if (cp < 0x20 || cp == 0x7f) editorPutCell(y, x, "?", 1, 0, inverse);
+		else if (w == 0) //combining mark, rides on the char before
+		{
+			cell *c = x > 0 ? editorCell(y, x - 1) : NULL;
+			if (c && c->n + n <= (int)sizeof(c->c))
+			{
+				memcpy(c->c + c->n, &s[j], n);
+				c->n += n;
+			}
+		}
+		else editorPutCell(y, x, &s[j], n, 0, inverse);
+		if (w == 2) editorPutCell(y, x + 1, "", 0, 0, inverse);
+	}
+}
+
+void editorDrawRows(editorPane *p) //the pane's text area, p's state is in E
+{
+	if (E.hex)
+	{
+		editorHexDrawRows(p);
+		return;
+	}
+	int y; //counter var for loops
+	int wseg = 0, wrow = E.wrap ? editorWrapDrawStart(&wseg) : 0, wnext = 0; //soft wrap: row and line drawn next, where the last one stopped
+	int frow = E.rowoff; //row drawn next, closed folds stepped over
+	for (y=0; y < E.screenrows; y++) //loop through local 'visible' rows
+	{
+		int filerow = frow, coloff = E.coloff; //Global row, first column shown
+		frow = editorFoldNext(frow);
+		if (E.wrap) //each screen line is one stretch of a row, as if scrolled sideways to it
+		{
+			filerow = wrow;
+			coloff = wseg == 0 ? 0 : y == 0 ? editorWrapStart(wrow, wseg) : wnext;
+			if (++wseg >= editorWrapLines(wrow)) wrow = editorFoldNext(wrow), wseg = 0;
+		}
+		int sy = p->top + y, x = p->left, xend = p->left + E.screencols; //screen row, next and last column
+		if(filerow >= E.numrows) //>= Allocatd Rows
+		{
+			if (E.numrows == 0 && E.npanes == 1 && y == E.screenrows/3) //Check Empty file, Position 1/3 from top
+			{
+				char welcome[80]; //MessageBuf
+				int welcomelen = snprintf(welcome, sizeof(welcome), "Kilo Editor -- version %s", KILO_VERSION); //Editor Version Message, Records Length
+				if (welcomelen > E.screencols) welcomelen = E.screencols; //Truncate len to 'visible' local columns
+				int padding = (E.screencols - welcomelen)/2; //Find Distance to Middle of screen
+				//Place Cursor in middle of screen
+				if (padding){
+					editorPutCell(sy, x++, "~", 1, 0, 0);
+					padding--;
+				}
+				while(padding--) editorPutCell(sy, x++, " ", 1, 0, 0);
+
+				editorPutText(sy, x, welcomelen, welcome, welcomelen, 0); //Print Welcome Message
+				x += welcomelen;
+			} else {
+				editorPutCell(sy, x++, "~", 1, 0, 0); //Tilda Empty Lines
+			}
+		} else //Global Row within allocated rows
+		{
+			erow *row = &E.row[filerow];
+			erowdraw *d = &E.rowdraw[filerow];
+			int ri = coloff, rx = coloff; //render offset and screen column to start from
+			if (row->utf8at != -1) editorRowWalk(row, offsetof(erowcp, rx), coloff, &rx, &ri); //multibyte: find where coloff lands
+			if (ri > d->rsize) ri = rx = d->rsize;
+			char *c = d->render; //Points to current row's render string
+			hlspan *sp = d->hl, *spend = d->hl + d->nhl; //next color run
+			int mat = (filerow == E.match_row) ? E.match_at : -1, matend = mat + E.match_len; //find overlay
+			int pa = -1, pb = -1; //bracket pair, only where the cursor is
+			if (p == &E.panes[E.curpane])
+			{
+				if (filerow == E.pair_row[0]) pa = E.pair_at[0];
+				if (filerow == E.pair_row[1]) pb = E.pair_at[1];
+			}
+			int j, n, w; //render index, bytes and columns of curr char
+			for (j = ri; j < d->rsize; j += n, rx += w) //loop through formatted render string (frs)
+			{
+				unsigned char ch = c[j];
+				int cp = ch;
+				n = w = 1;
+				if (ch >= 0x80) //utf-8, look up its width
+				{
+					n = editorUtf8Decode(&c[j], d->rsize - j, &cp);
+					w = editorCharWidth(cp);
+				}
+				if (rx + w > coloff + E.screencols) break; //past right edge
+				if (rx < coloff) //wide char cut by the left edge, pad what shows
+				{
+					for (int k = coloff; k < rx + w; k++) editorPutCell(sy, x++, " ", 1, 0, 0);
+					continue;
+				}
+
+				while (sp < spend && sp->off + sp->len <= j) sp++; //runs left behind
+				int hl = (sp < spend && sp->off <= j) ? sp->hl : HL_NORMAL;
+				if (j >= mat && j < matend) hl = HL_MATCH; //overlay wins
+				int color = hl == HL_NORMAL ? 0 : editorSyntaxToColor(hl);
+
+				if (ch < 0x20 || ch == 0x7f || cp < 0 || (cp >= 0x80 && cp < 0xa0)) //cntrl char or bad byte processing
+				{
+					char sym = (ch <= 26) ? '@' + ch : '?'; //render cntrl char as @A etc
+					editorPutCell(sy, x++, &sym, 1, 0, 1); //inverted
+				} else if (w == 0) //combining mark, rides on the char before
+				{
+					cell *prev = x > p->left ? editorCell(sy, x - 1) : NULL;
+					if (prev && prev->n + n <= (int)sizeof(prev->c))
+					{
+						memcpy(prev->c + prev->n, &c[j], n);
+						prev->n += n;
+					}
+				} else
+				{
+					editorPutCell(sy, x++, &c[j], n, color, j == pa || j == pb);
+					if (w == 2) editorPutCell(sy, x++, "", 0, color, 0);
+				}
+			}
+			wnext = rx; //the char that didn't fit starts the next line
+			if (j >= d->rsize && editorFoldHeader(filerow)) //closed fold, say how much is behind it
+			{
+				char tag[32];
+				int len = snprintf(tag, sizeof(tag), "+%d lines", editorFoldHeader(filerow));
+				if (x < xend) editorPutCell(sy, x++, " ", 1, 0, 0);
+				for (int k = 0; k < len && x < xend; k++) editorPutCell(sy, x++, &tag[k], 1, 0, 1);
+			}
+		}
+		while (x < xend) editorPutCell(sy, x++, " ", 1, 0, 0); //rest of the line is blank
+	}
+}
+
+#pragma endregion
+
+#pragma region //Editor Functions
+
+void editorScroll(){
+	//rx settings
+	E.rx = 0;
+	if (E.cy < E.numrows) {
+		E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+	}
+	if (E.fold.n) editorFoldReveal();
+	if (E.hex) E.rx = editorHexCol(E.cx); //the byte's hex digits
+	else if (E.wrap)
+	{
+		editorWrapScroll();
+		return;
+	}
+	//vert scroll
+	if (E.fold.ntop) editorFoldScroll(); //by shown lines
+	else {
+		if (E.cy < E.rowoff) {
+			E.rowoff = E.cy;
+		}
+		if (E.cy >= E.rowoff + E.screenrows){
+			E.rowoff = E.cy - E.screenrows + 1;
+		}
+	}
+	//horizontal scroll
+	if (E.rx < E.coloff){
+		E.coloff = E.rx;
+	}
+	if (E.rx >= E.coloff + E.screencols){
+		E.coloff = E.rx - E.screencols + 1;
+	}
+}
+
+void editorInsertChars(const char *s, int n){ //insert n bytes (one utf-8 char) at the cursor
+	//create row if one doesn't exist
+	if (E.cy == E.numrows){
+		editorInsertRow(E.numrows, "", 0);
+	}
+	editorRowInsertChars(&E.row[E.cy], E.cx, s, n);
+	E.cx += n;
+}
+
+void editorInsertChar(int c){
+	char ch = c;
+	editorInsertChars(&ch, 1);
+}
+
+void editorInsertNewline(){
+	if (E.cy == E.numrows){
+			editorInsertRow(E.cy, "", 0);
+	} else {
+		erow *row = &E.row[E.cy];
+		char tail[KILO_ROW_INLINE]; //an inline row's text moves with E.row if it grows
+		char *s = &row->chars[E.cx];
+		if (!row->cap) s = memcpy(tail, s, row->size - E.cx);
+		editorInsertRow(E.cy + 1, s, row->size - E.cx);
+		row = &E.row[E.cy];
+		if (!E.undo_suspended)
+		{
+			int cap;
+			char *text = editorArenaDup(&row->chars[E.cx], row->size - E.cx, &cap);
+			editorUndoPush(UNDO_TRUNCATE_ROW, E.cy, E.cx, 0, text, row->size - E.cx, cap);
+		}
+		row->size = E.cx;
+		row->chars[row->size] = '\0';
+		editorUpdateRowFrom(row, E.cx);
+	}
+	E.cy++;
+	E.cx = 0;
+}
+
+void editorDelChar(){
+	//create row if one doesn't exist
+	if (E.cy == E.numrows) return;
+	erow *row = &E.row[E.cy];
+	if (E.cx == 0 && E.cy == 0) {
+		editorRowDelChars(row, 0, editorRowNextCluster(row, 0));
+		return;
+	}
+	
+
+	if (E.cx > 0) {
+		int at = (E.cx < row->size) ? E.cx : editorRowPrevCluster(row, row->size); //at eol the last char goes
+		int prev = editorRowPrevCluster(row, E.cx);
+		editorRowDelChars(row, at, editorRowNextCluster(row, at) - at);
+		E.cx = prev;
+	} else {
+		E.cx = E.row[E.cy - 1].size;
+		editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
+		editorDelRow(E.cy);
+		E.cy--;
+	}
+
+
+	
+}
+
+void editorBackspace(){ //delete the whole char (cluster) before the cursor, or join with the line above
+	if (E.cy == E.numrows || (E.cx == 0 && E.cy == 0)) return;
+	erow *row = &E.row[E.cy];
+	if (E.cx > 0) {
+		int prev = editorRowPrevCluster(row, E.cx);
+		editorRowDelChars(row, prev, E.cx - prev);
+		E.cx = prev;
+	} else {
+		E.cx = E.row[E.cy - 1].size;
+		editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
+		editorDelRow(E.cy);
+		E.cy--;
+	}
+}
+
+//any issues later on check this
+//https://github.com/snaptoken/kilo-src/blob/status-bar-right/kilo.c
+void editorDrawStatusBar(editorPane *p) //status bar curr line/row, filetype, filename etc. under the pane
+{
+	char status[80], rstatus[80];//Left and Right corners of status bar
+	int sy = p->top + E.screenrows;
+
+	int len = snprintf(status, sizeof(status), "%.20s - %d, %d| %s | %d %s",
+		E.filename ? E.filename : "[No Name]",//write filename if exist
+		E.cx, //curr col
+		E.cy, //curr row
+		E.syntax ? E.syntax->filetype : "what?",
+		E.dirty, //num changes 
+		E.dirty ? "(Lines Modified)" : "(clean)"); 
+
+	char bufs[32] = "";
+	if (E.nbufs > 1) snprintf(bufs, sizeof(bufs), "buf %d/%d | ", E.curbuf + 1, E.nbufs);
+	int rlen = snprintf(rstatus, sizeof(rstatus), "%s%s%s%s%s | %d/%d", 
+	E.follow ? "follow | " : "",
+	E.wrap ? "wrap | " : "",
+	E.stream.buf >= 0 && E.stream.buf == E.curbuf ? "reading stdin | " : "",
+	bufs,
+	E.syntax ? E.syntax->filetype : "no ft", //display filetype if it exists
+	E.cy + 1, //curr visible row
+	E.numrows); //total rows
+	if (E.hex) rlen = snprintf(rstatus, sizeof(rstatus), "%shex | 0x%zx/0x%zx", bufs, (size_t)E.cy * E.hex_width + E.cx, E.hex_size); //offset of the cursor's byte
+
+	for (int x = 0; x < E.screencols; x++) editorPutCell(sy, p->left + x, " ", 1, 0, 1); //inverted bar
+	if (len > E.screencols) len = E.screencols; //print only vis col
+	editorPutText(sy, p->left, len, status, len, 1); //print status
+	if (E.screencols - len >= rlen) editorPutText(sy, p->left + E.screencols - rlen, rlen, rstatus, rlen, 1); //right aligned if it fits
+}
+
+void editorDrawMessageBar(){
+	int sy = E.termrows - 1;
+	for (int x = 0; x < E.termcols; x++) editorPutCell(sy, x, " ", 1, 0, 0);
+
+	if (E.prof.overlay)
+	{
+		char buf[128];
+		int len = editorProfOverlay(buf, sizeof(buf));
+		if (len > E.termcols) len = E.termcols;
+		editorPutText(sy, 0, E.termcols, buf, len, 0);
+		return;
+	}
+
+	int msglen = strlen(E.statusmsg);
+	if (msglen && time(NULL) - E.statusmsg_time < 5) editorPutText(sy, 0, E.termcols, E.statusmsg, msglen, 0);
+}
+
+void editorComposite(struct abuf *ab) //send the cells that differ from what the terminal shows
+{
+	int n = E.termrows * E.termcols;
+	int cy = -1, cx = -1; //where the terminal cursor is, -1 = unknown
+	int color = -1, inverse = -1; //current SGR, -1 = unknown
+	char buf[32];
+
+	if (!E.shown_valid) //start from a blank terminal
+	{
+		abAppend(ab, "\x1b[m\x1b[2J", 7);
+		for (int i = 0; i < n; i++) E.shown[i] = (cell){" ", 1, 0, 0, 0};
+		E.shown_valid = 1;
+	}
+	for (int y = 0; y < E.termrows; y++)
+	{
+		for (int x = 0; x < E.termcols; x++)
+		{
+			cell *want = editorCell(y, x), *have = &E.shown[y * E.termcols + x];
+			if (want->n == 0) continue; //right half, goes out with its left
+			int w = (x + 1 < E.termcols && want[1].n == 0) ? 2 : 1;
+			if (!memcmp(want, have, sizeof(cell)) && (w == 1 || !memcmp(&want[1], &have[1], sizeof(cell)))) continue;
+
+			int from = x; //a short run of unchanged plain cells is cheaper to resend than to jump over
+			if (cy == y && cx < x && x - cx <= 4)
+			{
+				from = cx;
+				for (int k = cx; k < x; k++)
+					if (editorCell(y, k)->n != 1 || editorCell(y, k)->color != want->color || editorCell(y, k)->inverse != want->inverse) from = x;
+			}
+			if (from == x && (cy != y || cx != x))
+			{
+				int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+				abAppend(ab, buf, len);
+			}
+			if (want->color != color || want->inverse != inverse)
+			{
+				color = want->color;
+				inverse = want->inverse;
+				int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dm", inverse ? 7 : 27, color ? color : 39);
+				abAppend(ab, buf, len);
+			}
+			for (int k = from; k < x; k++) abAppend(ab, editorCell(y, k)->c, 1);
+			abAppend(ab, want->c, want->n);
+			memcpy(have, want, sizeof(cell) * w);
+			cy = y;
+			cx = x + w;
+		}
+	}
+	if (color != -1) abAppend(ab, "\x1b[m", 3);
+}
+
+void editorDrawFrame(struct abuf *ab) //everything one screen update sends to the terminal
+{
+	editorPanesReady();
+	editorScroll();
+	editorBracketPair();
+
+	//?25l hides cursor/doesn't display
+	abAppend(ab, "\x1b[?25l", 6);
+
+	//every pane into the cell grid, each with its own buffer and scroll, then the separators
+	editorPane *cur = &E.panes[E.curpane];
+	editorPaneSave(cur);
+	for (int i = 0; i < E.npanes; i++)
+	{
+		editorPane *p = &E.panes[i];
+		editorPaneLoad(p);
+		if (p != cur) //its buffer may have shrunk or been folded under it
+		{
+			editorFoldSurface();
+			editorScroll();
+		}
+		editorDrawRows(p);
+		if (E.filename || E.npanes > 1 || (E.stream.buf >= 0 && E.stream.buf == E.curbuf)) editorDrawStatusBar(p);
+		else for (int x = 0; x < E.screencols; x++) editorPutCell(p->top + E.screenrows, p->left + x, " ", 1, 0, 0);
+		editorPaneSave(p);
+		if (p->left > 0)
+			for (int y = p->top; y <= p->top + p->rows; y++) editorPutCell(y, p->left - 1, "|", 1, 0, 0);
+	}
+	editorPaneLoad(cur);
+	editorDrawMessageBar();
+	editorComposite(ab);
+
+	//Reposition Cursor cx, cy
+	char buf[32];
+	int y = editorFoldLine(E.cy) - editorFoldLine(E.rowoff), x = E.rx - E.coloff; //closed folds take one line
+	if (E.wrap && !E.hex) editorWrapCursor(&y, &x);
+	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cur->top + y + 1, cur->left + x + 1);
+	abAppend(ab, buf, strlen(buf));
+	
+	//?25h unhides cursor
+	abAppend(ab, "\x1b[?25h", 6);
+}
+
+void editorRefreshScreen() {
+	long t0 = E.prof.on ? editorProfNow() : 0;
+	if (t0 && E.prof.t_key) editorProfAdd(&E.prof.key, t0 - E.prof.t_key);
+
+	//init buf
+	struct abuf ab = ABUF_INIT;
+	editorDrawFrame(&ab);
+	long t1 = E.prof.on ? editorProfNow() : 0;
+
+	//write buf out
+	write(E.outfd, ab.b, ab.len);
+	if (E.replay.keys) editorReplayFrame(ab.len);
+	if (E.prof.on)
+	{
+		long t2 = editorProfNow();
+		editorProfAdd(&E.prof.draw, t1 - t0);
+		editorProfAdd(&E.prof.write, t2 - t1);
+		if (E.prof.t_key) editorProfAdd(&E.prof.lat, t2 - E.prof.t_key);
+		E.prof.t_key = 0;
+		E.prof.frames++;
+		E.prof.bytes += ab.len;
+	}
+	abFree(&ab);
+}
+
+void editorSetStatusMessage(const char *fmt, ...){
+	va_list ap;
+	va_start(ap,fmt);
+	vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+	va_end(ap);
+	E.statusmsg_time = time(NULL);
+}
+#pragma endregion
+
+#pragma region /*** Highlight Cache ***/
+
+//opening a big file twice shouldn't mean splitting and highlighting it twice. after a file is saved or
+//closed clean, its line index and highlight spans go to $KILO_CACHE_DIR (default ~/.cache/kilo) keyed
+//by device/inode, and are only used again if size, mtime and a hash of the content all still match
+
+#define KILO_CACHE_MAGIC "KILOHL1" //bump when the layout or the highlighter changes
+
+struct cacheHeader
+{
+	char magic[8];
+	uint64_t dev, ino, size;
+	int64_t mtime, mtime_ns;
+	uint64_t hash; //of the whole file
+	char filetype[16]; //highlighter the spans came from, "" for none
+	uint64_t numrows, nspans;
+};
+
+struct cacheRow //followed in the file by all rows' spans back to back
+{
+	uint64_t start; //file offset
+	uint32_t len;
+	uint32_t nhl;
+	uint32_t open_comment;
+	uint32_t pad;
+};
+
+uint64_t editorHash(const unsigned char *p, size_t n) //fast 64 bit content hash, 8 bytes a step
+{
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ n;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		uint64_t v;
+		memcpy(&v, &p[i], 8);
+		h = (h ^ v) * 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+	}
+	for (; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ULL;
+	return h ^ (h >> 29);
+}
+
+char *editorCachePath(struct stat *st) //where the cache for this file lives, NULL if there's no cache dir
+{
+	char dir[PATH_MAX];
+	char *env = getenv("KILO_CACHE_DIR");
+	if (env && !*env) return NULL; //set but empty = off
+	if (env) snprintf(dir, sizeof(dir), "%s", env);
+	else
+	{
+		char *home = getenv("HOME");
+		if (!home) return NULL;
+		snprintf(dir, sizeof(dir), "%s/.cache", home);
+		mkdir(dir, 0755);
+		snprintf(dir, sizeof(dir), "%s/.cache/kilo", home);
+	}
+	mkdir(dir, 0755);
+	char *path = malloc(PATH_MAX + 64);
+	snprintf(path, PATH_MAX + 64, "%s/%llx-%llx.hl", dir, (unsigned long long)st->st_dev, (unsigned long long)st->st_ino);
+	return path;
+}
+
+int editorCacheValid(struct cacheHeader *h, struct stat *st, const char *data) //cache header still describes the file
+{
+	if (memcmp(h->magic, KILO_CACHE_MAGIC, 8)) return 0;
+	if (h->dev != (uint64_t)st->st_dev || h->ino != (uint64_t)st->st_ino || h->size != (uint64_t)st->st_size) return 0;
+	if (h->mtime != st->st_mtim.tv_sec || h->mtime_ns != st->st_mtim.tv_nsec) return 0;
+	if (strncmp(h->filetype, E.syntax ? E.syntax->filetype : "", sizeof(h->filetype))) return 0;
+	return h->hash == editorHash((const unsigned char *)data, st->st_size); //last, it reads the whole file
+}
+
+int editorCacheLoad(const char *data, struct stat *st) //build the rows of the mapped file from its cache, 1 if it was usable
+{
+	char *path = editorCachePath(st);
+	if (!path) return 0;
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd == -1) return 0;
+	struct stat cst;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &cst) == 0 && cst.st_size >= (off_t)sizeof(struct cacheHeader)) map = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return 0;
+
+	struct cacheHeader *h = map;
+	int ok = h->numrows <= h->size + 1 && h->nspans <= h->size //sizes add up before anything is trusted
+		&& sizeof(*h) + h->numrows * sizeof(struct cacheRow) + h->nspans * sizeof(hlspan) == (uint64_t)cst.st_size
+		&& editorCacheValid(h, st, data);
+	struct cacheRow *rows = (struct cacheRow *)(h + 1);
+	hlspan *spans = (hlspan *)(rows + (ok ? h->numrows : 0));
+	uint64_t left = h->nspans;
+	for (uint64_t i = 0; ok && i < h->numrows; i++)
+	{
+		struct cacheRow *r = &rows[i];
+		if (r->start + r->len > h->size || r->nhl > left) //corrupt, start over the slow way
+		{
+			editorFreeRows();
+			ok = 0;
+			break;
+		}
+		editorInsertRow(E.numrows, (char *)&data[r->start], r->len);
+		erow *row = &E.row[E.numrows - 1];
+		erowdraw *d = &E.rowdraw[E.numrows - 1];
+		if (r->nhl) d->hl = arenaRealloc(&E.arena, d->hl, d->hlcap, sizeof(hlspan) * r->nhl, &d->hlcap);
+		if (r->nhl) memcpy(d->hl, spans, sizeof(hlspan) * r->nhl);
+		d->nhl = r->nhl;
+		row->hl_open_comment = r->open_comment;
+		editorHlDone(row);
+		editorBracketRow(row);
+		spans += r->nhl;
+		left -= r->nhl;
+	}
+	munmap(map, cst.st_size);
+	if (ok) E.hl_from = INT_MAX; //all rows came with their colors
+	return ok;
+}
+
+void editorCacheStore() //remember the line index and colors of the buffer, if it's exactly what's on disk
+{
+	if (!E.filename || E.dirty || E.grep_view || E.cache_hit || E.gzip || E.hex) return;
+	int fd = open(E.filename, O_RDONLY);
+	if (fd == -1) return;
+	struct stat st;
+	char *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return;
+	char *path = editorCachePath(&st);
+	FILE *fp = NULL;
+	char tmp[PATH_MAX + 72];
+	if (path)
+	{
+		snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+		fp = fopen(tmp, "w");
+	}
+	if (!fp) goto csEnd;
+
+	editorHlFlush(); //spans have to be final
+
+	struct cacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, KILO_CACHE_MAGIC, 8);
+	h.dev = st.st_dev;
+	h.ino = st.st_ino;
+	h.size = st.st_size;
+	h.mtime = st.st_mtim.tv_sec;
+	h.mtime_ns = st.st_mtim.tv_nsec;
+	h.hash = editorHash((unsigned char *)data, st.st_size);
+	if (E.syntax) strncpy(h.filetype, E.syntax->filetype, sizeof(h.filetype) - 1);
+	h.numrows = E.numrows;
+	for (int i = 0; i < E.numrows; i++) h.nspans += E.rowdraw[i].nhl;
+	fwrite(&h, sizeof(h), 1, fp);
+
+	//line index, found the same way editorOpen splits and checked against the rows
+	char *p = data, *end = data + st.st_size;
+	int i;
+	for (i = 0; i < E.numrows && p < end; i++)
+	{
+		char *nl = memchr(p, '\n', end - p);
+		char *eol = nl ? nl : end;
+		while (eol > p && eol[-1] == '\r') eol--;
+		erow *row = &E.row[i];
+		if (eol - p != row->size || memcmp(p, row->chars, row->size)) break; //buffer isn't the file after all
+		struct cacheRow r = {p - data, row->size, E.rowdraw[i].nhl, row->hl_open_comment, 0};
+		fwrite(&r, sizeof(r), 1, fp);
+		p = nl ? nl + 1 : end;
+	}
+	for (int k = 0; k < E.numrows && i == E.numrows && p == end; k++) fwrite(E.rowdraw[k].hl, sizeof(hlspan), E.rowdraw[k].nhl, fp);
+
+	if (fclose(fp) == 0 && i == E.numrows && p == end) rename(tmp, path);
+	else unlink(tmp);
+
+csEnd:
+	free(path);
+	munmap(data, st.st_size);
+}
+
+void editorSplitRows(const char *data, size_t len) //one row per line of a mapped file, same trimming as the getline loop
+{
+	const char *p = data, *end = data + len;
+	while (p < end)
+	{
+		const char *nl = memchr(p, '\n', end - p);
+		const char *eol = nl ? nl : end;
+		while (eol > p && eol[-1] == '\r') eol--;
+		editorInsertRow(E.numrows, (char *)p, eol - p);
+		p = nl ? nl + 1 : end;
+	}
+}
+
+#pragma endregion
+
+#pragma region /*** Gzip ***/
+
+//a file that starts with the gzip magic is inflated on open a megabyte at a time straight into rows,
+//split like follow mode appends, so the whole text never sits in memory twice and no file is
+//unpacked anywhere. the buffer remembers it was gzip and Ctrl-S compresses again, on a thread:
+//the rows are flattened on the main thread like any save, the writer deflates them a block at a
+//time into a temp file next to the target and renames it over, and the idle loop picks up the
+//result (the file's new size and inode for reload). the buffer stays dirty until then, so a save
+//that fails leaves the old file whole and the edits unsaved. one save in flight at a time, a
+//second one waits for the first. quitting waits for it too
+
+#define GZ_BLOCK (1 << 20) //inflate output per step
+
+int editorGzipMagic(const char *data, size_t len){
+	return len >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b;
+}
+
+int editorGzipInflate(const char *data, size_t len, void (*sink)(const char *, int, void *), void *arg, size_t *total)
+//every member of a .gz, a block at a time into sink. 0 if the stream is damaged, what came before it was still sunk
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, 15 + 16) != Z_OK) return 0;
+	char *out = malloc(GZ_BLOCK);
+	const char *end = data + len;
+	int ret = Z_OK;
+	*total = 0;
+	for (;;)
+	{
+		if (zs.avail_in == 0 && data < end) //zlib counts in uInt, a big file goes in slices
+		{
+			zs.next_in = (Bytef *)data;
+			zs.avail_in = end - data < (1L << 30) ? end - data : (1L << 30);
+			data += zs.avail_in;
+		}
+		zs.next_out = (Bytef *)out;
+		zs.avail_out = GZ_BLOCK;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		int n = GZ_BLOCK - zs.avail_out;
+		if (n) sink(out, n, arg);
+		*total += n;
+		if (ret == Z_STREAM_END)
+		{
+			if (zs.avail_in == 0 && data == end) break;
+			inflateReset(&zs); //gzip a b > ab, one member after another
+		}
+		else if (ret != Z_OK || (n == 0 && zs.avail_in == 0 && data == end)) break; //damaged, or cut short
+	}
+	inflateEnd(&zs);
+	free(out);
+	return ret == Z_STREAM_END;
+}
+
+void editorGzipRowSink(const char *s, int len, void *arg){
+	(void)arg;
+	editorFollowAppend(s, len);
+}
+
+void editorGzipSplit(const char *data, size_t len) //a mapped .gz into rows, with the rate in the message bar to hold against zcat
+{
+	long t0 = editorProfNow();
+	size_t total;
+	int partial = E.follow_partial;
+	E.follow_partial = 0; //the first line starts a row
+	int ok = editorGzipInflate(data, len, editorGzipRowSink, NULL, &total);
+	E.follow_partial = partial;
+	double ms = (editorProfNow() - t0) / 1e6;
+	if (!ok) editorSetStatusMessage("%s: damaged after %zu bytes", E.filename, total);
+	else editorSetStatusMessage("%s: %.1f MB inflated in %.0f ms, %.0f MB/s", E.filename, total / 1e6, ms, ms > 0 ? total / 1e3 / ms : 0.0);
+}
+
+struct gzBuf
+{
+	char *p;
+	size_t len, cap;
+};
+
+void editorGzipBufSink(const char *s, int len, void *arg){
+	struct gzBuf *b = arg;
+	if (b->len + len > b->cap)
+	{
+		while (b->len + len > b->cap) b->cap = b->cap ? b->cap * 2 : GZ_BLOCK;
+		b->p = realloc(b->p, b->cap);
+	}
+	memcpy(b->p + b->len, s, len);
+	b->len += len;
+}
+
+char *editorGzipText(const char *data, size_t len, size_t *outlen) //a whole .gz inflated into one malloc'd block, NULL if damaged
+{
+	struct gzBuf b = {NULL, 0, 0};
+	size_t total;
+	if (!editorGzipInflate(data, len, editorGzipBufSink, &b, &total))
+	{
+		free(b.p);
+		return NULL;
+	}
+	*outlen = b.len;
+	return b.p ? b.p : malloc(1);
+}
+
+void *editorGzipWriter(void *arg) //deflate the flattened rows into a temp file beside the target, then rename it over
+{
+	struct editorGzipJob *j = arg;
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	size_t plen = strlen(j->path);
+	char *out = malloc(GZ_BLOCK), *tmp = malloc(plen + 16);
+	memcpy(tmp, j->path, plen);
+	memcpy(&tmp[plen], ".kilo-XXXXXX", 13); //same dir, so the rename can't cross filesystems
+	int fd = -1, err = 0, ret = Z_OK;
+	size_t outlen = 0, fed = 0;
+	struct stat st;
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free(out);
+		free(tmp);
+		err = ENOMEM;
+		goto gwDone;
+	}
+	if ((fd = mkstemp(tmp)) == -1) err = errno;
+	while (!err && ret != Z_STREAM_END) //GZ_BLOCK in, whatever deflate has ready out
+	{
+		if (!zs.avail_in && fed < (size_t)j->len)
+		{
+			size_t n = j->len - fed < GZ_BLOCK ? j->len - fed : GZ_BLOCK;
+			zs.next_in = (Bytef *)j->data + fed;
+			zs.avail_in = n;
+			fed += n;
+		}
+		zs.next_out = (Bytef *)out;
+		zs.avail_out = GZ_BLOCK;
+		ret = deflate(&zs, fed == (size_t)j->len ? Z_FINISH : Z_NO_FLUSH);
+		if (ret == Z_STREAM_ERROR) err = EIO;
+		for (size_t done = 0, have = GZ_BLOCK - zs.avail_out; !err && done < have; )
+		{
+			ssize_t n = write(fd, out + done, have - done);
+			if (n <= 0) err = n ? errno : EIO;
+			else done += n;
+		}
+	}
+	outlen = zs.total_out;
+	deflateEnd(&zs);
+	if (!err && (fchmod(fd, j->mode) == -1 || fsync(fd) == -1 || fstat(fd, &st) == -1)) err = errno;
+	if (!err && rename(tmp, j->path) == -1) err = errno;
+	if (fd != -1) close(fd);
+	if (err && fd != -1) unlink(tmp); //the old file was never touched
+	free(out);
+	free(tmp);
+
+gwDone:
+	pthread_mutex_lock(&j->lock);
+	j->done = 1;
+	j->err = err;
+	j->outlen = outlen;
+	if (!err) j->st = st;
+	pthread_mutex_unlock(&j->lock);
+	return NULL;
+}
+
+void editorGzipCollect() //the writer is joined, its result goes to the buffer it was for
+{
+	struct editorGzipJob *j = &E.gzjob;
+	j->active = 0;
+	int cur = E.curbuf;
+	if (j->buf != cur) editorBufferSwap(j->buf);
+	if (j->err)
+	{
+		memFree(MEM_DISKHASH, j->hash, sizeof(uint64_t) * j->lines); //still dirty, quitting asks first
+		editorSetStatusMessage("can't save %s: %s", j->path, strerror(j->err));
+	}
+	else
+	{
+		E.dirty = E.dirty > j->dirty ? E.dirty - j->dirty : 0; //edits made while it was compressing aren't in it
+		E.cache_hit = 0;
+		memFree(MEM_DISKHASH, E.disk_hash, sizeof(uint64_t) * E.disk_lines);
+		E.disk_hash = j->hash;
+		E.disk_lines = j->lines;
+		E.disk_size = j->st.st_size;
+		E.disk_dev = j->st.st_dev;
+		E.disk_ino = j->st.st_ino;
+		E.disk_mtime = j->st.st_mtim;
+		editorSetStatusMessage("%d bytes written to disk (%zu gzipped)", j->len, j->outlen);
+	}
+	if (E.curbuf != cur) editorBufferSwap(cur);
+	free(j->path);
+	free(j->data);
+	j->path = j->data = NULL;
+	j->hash = NULL;
+}
+
+void editorGzipWait() //finish the save in flight, if any
+{
+	if (!E.gzjob.active) return;
+	pthread_join(E.gzjob.writer, NULL);
+	editorGzipCollect();
+}
+
+void editorGzipExit() //atexit, a save that was started still lands, or says it didn't
+{
+	struct editorGzipJob *j = &E.gzjob;
+	if (!j->active) return;
+	pthread_join(j->writer, NULL);
+	j->active = 0;
+	if (j->err) fprintf(stderr, "kilo: can't save %s: %s\r\n", j->path, strerror(j->err));
+}
+
+int editorGzipSaved() //idle hook: pick up a finished save, 1 if the message bar changed
+{
+	struct editorGzipJob *j = &E.gzjob;
+	if (!j->active) return 0;
+	pthread_mutex_lock(&j->lock);
+	int done = j->done;
+	pthread_mutex_unlock(&j->lock);
+	if (!done) return 0;
+	editorGzipWait();
+	return 1;
+}
+
+void editorGzipSave(char *data, int len) //E's buffer, flattened, to the writer. takes data
+{
+	static int hooked;
+	struct editorGzipJob *j = &E.gzjob;
+	editorGzipWait();
+	if (!hooked)
+	{
+		pthread_mutex_init(&j->lock, NULL);
+		atexit(editorGzipExit);
+		hooked = 1;
+	}
+	j->buf = E.curbuf;
+	j->path = realpath(E.filename, NULL); //a link keeps pointing at the file
+	if (!j->path) j->path = strdup(E.filename); //a new one
+	struct stat st;
+	if (stat(j->path, &st) == 0) j->mode = st.st_mode & 07777;
+	else
+	{
+		mode_t mask = umask(0);
+		umask(mask);
+		j->mode = 0666 & ~mask;
+	}
+	j->data = data;
+	j->len = len;
+	j->dirty = E.dirty;
+	j->lines = E.numrows;
+	j->hash = memAlloc(MEM_DISKHASH, sizeof(uint64_t) * E.numrows);
+	for (int i = 0; i < E.numrows; i++) j->hash[i] = editorRowHash(&E.row[i]);
+	j->done = j->err = 0;
+	j->active = 1;
+	if (pthread_create(&j->writer, NULL, editorGzipWriter, j) != 0)
+	{
+		editorGzipWriter(j); //no thread, write it now
+		editorGzipCollect();
+		return;
+	}
+	editorSetStatusMessage("compressing %d bytes to %s", len, E.filename);
+}
+
+#pragma endregion
+
+#pragma region /*** Hex View ***/
+
+//a file with a NUL in its first 8K opens as a hex dump instead of being split on whatever 0x0a
+//bytes it has. the mapping is kept and nothing is indexed: line y is the bytes at y * hex_width,
+//so a multi-GB image opens as fast as a small one and only the lines on screen are ever touched.
+//E.cy is the line and E.cx the byte in it, the view is read only. Ctrl-X switches a saved
+//buffer between its text and the hex dump of its file
+
+int editorHexLooksBinary(const char *data, size_t len){
+	return memchr(data, '\0', len < 8192 ? len : 8192) != NULL;
+}
+
+int editorHexDigits() //offset column width, 8 unless the file is past 4GB
+{
+	int d = 8;
+	while (d < 16 && (E.hex_size - 1) >> (4 * d)) d++;
+	return d;
+}
+
+int editorHexLineLen(int width) //"offset  hh hh .. hh  hh .. hh  |ascii|", a space between each 8 bytes
+{
+	return editorHexDigits() + 2 + width * 3 + width / 8 + 2 + width;
+}
+
+int editorHexCol(int i) //screen column of byte i's first digit
+{
+	return editorHexDigits() + 2 + i * 3 + i / 8;
+}
+
+int editorHexRows(){
+	size_t rows = (E.hex_size + E.hex_width - 1) / E.hex_width;
+	return rows > INT_MAX ? INT_MAX : rows;
+}
+
+void editorHexStart(unsigned char *map, size_t size) //map becomes the buffer's hex view, it owns the mapping now
+{
+	madvise(map, size, MADV_RANDOM); //paging around, not reading through
+	E.hex = map;
+	E.hex_size = size;
+	E.hex_width = 16;
+	if (size / 16 > INT_MAX || E.screencols >= editorHexLineLen(32)) E.hex_width = 32;
+	E.syntax = NULL;
+}
+
+void editorHexFormat(const unsigned char *in, int n, char *hex, char *ascii) //n <= 16 bytes to 2n digits and n printable chars
+{
+#ifdef __SSE2__
+	unsigned char tmp[16];
+	if (n < 16) //never load past the end of the mapping
+	{
+		memset(tmp, 0, sizeof(tmp));
+		memcpy(tmp, in, n);
+		in = tmp;
+	}
+	char h[32], a[16];
+	__m128i v = _mm_loadu_si128((const __m128i *)in), mask = _mm_set1_epi8(0x0f);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask), lo = _mm_and_si128(v, mask);
+	__m128i d0 = _mm_unpacklo_epi8(hi, lo), d1 = _mm_unpackhi_epi8(hi, lo); //digits in print order
+	__m128i nine = _mm_set1_epi8(9), zero = _mm_set1_epi8('0'), af = _mm_set1_epi8('a' - '0' - 10);
+	d0 = _mm_add_epi8(_mm_add_epi8(d0, zero), _mm_and_si128(_mm_cmpgt_epi8(d0, nine), af));
+	d1 = _mm_add_epi8(_mm_add_epi8(d1, zero), _mm_and_si128(_mm_cmpgt_epi8(d1, nine), af));
+	_mm_storeu_si128((__m128i *)h, d0);
+	_mm_storeu_si128((__m128i *)(h + 16), d1);
+	//signed compares: 0x20..0x7e is printable, bytes >= 0x80 are negative and fail the first test
+	__m128i pr = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+	_mm_storeu_si128((__m128i *)a, _mm_or_si128(_mm_and_si128(pr, v), _mm_andnot_si128(pr, _mm_set1_epi8('.'))));
+	memcpy(hex, h, 2 * n);
+	memcpy(ascii, a, n);
+#else
+	static const char digits[] = "0123456789abcdef";
+	for (int i = 0; i < n; i++)
+	{
+		hex[2 * i] = digits[in[i] >> 4];
+		hex[2 * i + 1] = digits[in[i] & 0x0f];
+		ascii[i] = (in[i] >= 0x20 && in[i] < 0x7f) ? in[i] : '.';
+	}
+#endif
+}
+
+int editorHexLine(int y, char *line) //line y of the dump into line, returns its length
+{
+	int w = E.hex_width, digits = editorHexDigits();
+	size_t off = (size_t)y * w;
+	int n = E.hex_size - off < (size_t)w ? (int)(E.hex_size - off) : w;
+	char hex[64], ascii[32];
+	for (int k = 0; k < n; k += 16) editorHexFormat(E.hex + off + k, n - k < 16 ? n - k : 16, hex + 2 * k, ascii + k);
+
+	int len = snprintf(line, digits + 1, "%0*zx", digits, off);
+	memset(line + len, ' ', editorHexLineLen(w) - len);
+	for (int i = 0; i < n; i++) memcpy(line + editorHexCol(i), hex + 2 * i, 2);
+	len = editorHexCol(w); //two spaces after the last byte
+	line[len++] = '|';
+	memcpy(line + len, ascii, n);
+	len += n;
+	line[len++] = '|';
+	return len;
+}
+
+void editorHexDrawRows(editorPane *p) //editorDrawRows for a hex view
+{
+	int rows = editorHexRows(), asc = editorHexCol(E.hex_width) + 1;
+	char line[256];
+	for (int y = 0; y < E.screenrows; y++)
+	{
+		int filerow = y + E.rowoff, sy = p->top + y, x = p->left, xend = p->left + E.screencols;
+		if (filerow >= rows) editorPutCell(sy, x++, "~", 1, 0, 0);
+		else
+		{
+			int len = editorHexLine(filerow, line);
+			if (len > E.coloff) editorPutText(sy, x, E.screencols, line + E.coloff, len - E.coloff, 0);
+			x += len > E.coloff ? (len - E.coloff < E.screencols ? len - E.coloff : E.screencols) : 0;
+			int at = asc + E.cx - E.coloff; //the cursor's byte, marked on the text side too
+			if (filerow == E.cy && at >= 0 && at < E.screencols) editorCell(sy, p->left + at)->inverse = 1;
+		}
+		while (x < xend) editorPutCell(sy, x++, " ", 1, 0, 0);
+	}
+}
+
+void editorHexClamp() //keep the cursor on a byte of the file
+{
+	int rows = editorHexRows();
+	if (E.cy >= rows) E.cy = rows ? rows - 1 : 0;
+	if (E.cy < 0) E.cy = 0;
+	if (E.cx >= E.hex_width) E.cx = E.hex_width - 1;
+	if (E.cx < 0) E.cx = 0;
+	size_t off = (size_t)E.cy * E.hex_width;
+	if (E.hex_size && off + E.cx >= E.hex_size) E.cx = E.hex_size - 1 - off;
+	if (!E.hex_size) E.cx = 0;
+}
+
+int editorHexProcessKey(int c) //hex view moves by bytes and is read only, returns 1 if c was handled
+{
+	int rows = editorHexRows(), w = E.hex_width;
+	switch (c)
+	{
+		case ARROW_UP:
+			E.cy--;
+			break;
+		case ARROW_DOWN:
+			E.cy++;
+			break;
+		case ARROW_LEFT:
+			if (E.cx > 0) E.cx--;
+			else if (E.cy > 0)
+			{
+				E.cy--;
+				E.cx = w - 1;
+			}
+			break;
+		case ARROW_RIGHT:
+			if (E.cx < w - 1) E.cx++;
+			else if (E.cy < rows - 1)
+			{
+				E.cy++;
+				E.cx = 0;
+			}
+			break;
+		case PAGE_UP:
+			E.cy -= E.screenrows;
+			E.rowoff -= E.screenrows;
+			if (E.rowoff < 0) E.rowoff = 0;
+			break;
+		case PAGE_DOWN:
+			E.cy += E.screenrows;
+			if (E.rowoff + E.screenrows < rows) E.rowoff += E.screenrows;
+			break;
+		case HOME_KEY:
+			E.cx = 0;
+			break;
+		case END_KEY:
+			E.cx = w - 1;
+			break;
+		case CTRL_KEY('q'):
+		case CTRL_KEY('n'):
+		case CTRL_KEY('b'):
+		case CTRL_KEY('o'):
+		case CTRL_KEY('w'):
+		case CTRL_KEY('x'):
+		case DISK_CHANGED:
+			return 0; //quit, buffers, panes, back to text, reload
+		default:
+			return 1; //swallow edits
+	}
+	editorHexClamp();
+	return 1;
+}
+
+void editorHexToggle() //Ctrl-X
+{
+	if (!E.filename || E.grep_view || E.gzip || (!E.hex && !E.disk_ino))
+	{
+		editorSetStatusMessage("hex view needs a buffer read from a plain file");
+		return;
+	}
+	if (E.dirty)
+	{
+		editorSetStatusMessage("Unsaved changes, save first (Ctrl-S)");
+		return;
+	}
+	int want = E.hex ? -1 : 1;
+	if (E.follow) editorFollowStop();
+	char *path = strdup(E.filename);
+	editorFreeRows();
+	E.hex_want = want;
+	int err = editorOpen(path);
+	free(path);
+	if (err) return;
+	if (want > 0 && !E.hex) editorSetStatusMessage("%s is empty, nothing to show in hex", E.filename);
+	else editorSetStatusMessage(E.hex ? "hex view, %d bytes a line, Ctrl-X for text" : "text view, Ctrl-X for hex", E.hex_width);
+}
+
+void editorHexReload() //DISK_CHANGED in hex view: map the new file, the cursor stays on its offset
+{
+	size_t off = (size_t)E.cy * E.hex_width + E.cx;
+	int rowoff = E.rowoff;
+	char *path = strdup(E.filename);
+	editorFreeRows();
+	E.hex_want = 1;
+	int err = editorOpen(path);
+	free(path);
+	if (err || !E.hex) return; //empty now, it's an empty text buffer
+	E.cy = off / E.hex_width;
+	E.cx = off % E.hex_width;
+	E.rowoff = rowoff;
+	editorHexClamp();
+	editorSetStatusMessage("reloaded from disk, %zu bytes", E.hex_size);
+}
+
+#pragma endregion
+
+#pragma region /*** Soft Wrap ***/
+
+//Ctrl-V folds rows at the pane width instead of scrolling sideways. a line breaks before the first
+//char that would cross the edge, for plain ASCII rows that's every width columns so their line
+//count is arithmetic, rows with utf-8 in them (wide chars) are walked once when rendered.
+//wrap_lines keeps each row's count and wrap_tree is a Fenwick tree over them: the top of the pane,
+//the cursor's line and page up/down are a prefix sum or a descent, O(log n) however many rows or
+//lines there are. an edit inside a row is a point update. the counts keep a gap at the last row
+//that came or went, like the bracket leaves: rows coming or going there take or give gap slots,
+//a point update each, and a jump moves only the rows between the gap and the edit across it.
+//it counts for one width, two panes of different widths on one buffer redo it in turn
+
+int editorWrapWalk(erow *row, int rx, int seg, int *start) //line of a utf-8 row that column rx is on, stopping early at line seg. *start = where it begins
+{
+	erowdraw *d = editorRowDraw(row);
+	int w = E.wrap_width, line = 0, from = 0, x = 0; //line, its first column, column of the char
+	for (int j = 0; j < d->rsize; )
+	{
+		if ((unsigned char)d->render[j] < 0x80) //a run of ASCII breaks every w columns, no need to step through it
+		{
+			int run = editorFirstHighByte(&d->render[j], d->rsize - j);
+			if (run == -1) run = d->rsize - j;
+			int last = rx < x + run ? rx : x + run - 1; //last column that matters
+			int first = x > from + w ? x : from + w; //first break, x is past it after a wide char on a 1 column line
+			int k = last >= first ? (last - first) / w + 1 : 0; //breaks up to last
+			int stop = rx <= last || k > seg - line;
+			if (k > seg - line) k = seg - line;
+			line += k;
+			if (k) from = first + (k - 1) * w;
+			if (stop) break;
+			x += run;
+			j += run;
+			continue;
+		}
+		int cp, n, cw; //same widths editorDrawRows uses
+		n = editorUtf8Decode(&d->render[j], d->rsize - j, &cp);
+		cw = editorCharWidth(cp);
+		if (x + cw > from + w && x > from) //doesn't fit, the line breaks before it
+		{
+			if (line == seg) break;
+			line++;
+			from = x;
+		}
+		if (x + cw > rx) break;
+		x += cw;
+		j += n;
+	}
+	if (start) *start = from;
+	return line;
+}
+
+int editorWrapRowLines(erow *row) //visual lines of a row at wrap_width
+{
+	int at = row - E.row, rsize = E.rowdraw[at].rsize;
+	if (E.fold.ntop && editorFoldShown(at) != at) return 0; //behind a closed fold
+	if (row->utf8at != -1) return editorWrapWalk(row, INT_MAX, INT_MAX, NULL) + 1;
+	return rsize > 0 ? (rsize + E.wrap_width - 1) / E.wrap_width : 1; //render columns are bytes
+}
+
+int editorWrapSlot(int row) //slot of row in wrap_lines
+{
+	return row < E.wrap_gap ? row : row + E.wrap_cap - E.numrows;
+}
+
+int editorWrapLines(int row) //visual lines of row, the empty line past the end has one
+{
+	return row < E.numrows ? E.wrap_lines[editorWrapSlot(row)] : 1;
+}
+
+int editorWrapStart(int row, int seg) //first column of line seg of row
+{
+	if (row >= E.numrows || seg == 0) return 0;
+	erow *r = &E.row[row];
+	if (r->utf8at == -1) return seg * E.wrap_width;
+	int start;
+	editorWrapWalk(r, INT_MAX, seg, &start);
+	return start;
+}
+
+int editorWrapSeg(int row, int rx) //line of row that column rx is on, the end of a row that fills its last line stays on it
+{
+	if (row >= E.numrows) return 0;
+	erow *r = &E.row[row];
+	if (r->utf8at != -1) return editorWrapWalk(r, rx, INT_MAX, NULL);
+	int seg = rx / E.wrap_width, last = editorWrapLines(row) - 1;
+	return seg < last ? seg : last;
+}
+
+void editorWrapBuild() //wrap_tree from wrap_lines, O(slots)
+{
+	int n = E.wrap_cap, *t = E.wrap_tree;
+	for (int j = 1; j <= n; j++) t[j] = E.wrap_lines[j - 1];
+	for (int j = 1; j <= n; j++) if (j + (j & -j) <= n) t[j + (j & -j)] += t[j];
+}
+
+void editorWrapAdd(int slot, int d) //wrap_lines[slot] += d
+{
+	E.wrap_lines[slot] += d;
+	for (int j = slot + 1; d && j <= E.wrap_cap; j += j & -j) E.wrap_tree[j] += d;
+}
+
+void editorWrapReserve(int n) //room for n rows, doubling. the rows past the gap move to the new end
+{
+	if (n <= E.wrap_cap && E.wrap_lines) return;
+	int cap = E.wrap_cap ? E.wrap_cap : 64, old = E.wrap_cap, tail = E.numrows - E.wrap_gap;
+	while (cap < n) cap *= 2;
+	E.wrap_lines = memRealloc(MEM_WRAP, E.wrap_lines, sizeof(int) * old, sizeof(int) * cap);
+	E.wrap_tree = memRealloc(MEM_WRAP, E.wrap_tree, old ? sizeof(int) * (old + 1) : 0, sizeof(int) * (cap + 1));
+	E.wrap_cap = cap;
+	if (!E.wrap_width) return; //everything is counted again anyway
+	memmove(&E.wrap_lines[cap - tail], &E.wrap_lines[old - tail], sizeof(int) * tail);
+	memset(&E.wrap_lines[E.wrap_gap], 0, sizeof(int) * (cap - tail - E.wrap_gap));
+	editorWrapBuild();
+}
+
+void editorWrapRow(erow *row) //row was just rendered
+{
+	int i = row - E.row;
+	if (i < 0 || i >= E.numrows) return;
+	int k = editorWrapSlot(i);
+	editorWrapAdd(k, editorWrapRowLines(row) - E.wrap_lines[k]);
+}
+
+void editorWrapShift(int at, int n) //n rows inserted at at (n < 0: removed), before numrows changes
+{
+	if (!E.wrap) return;
+	if (!E.wrap_width) //counted from scratch at the next draw, only the room matters
+	{
+		E.wrap_gap = E.numrows;
+		if (n > 0) editorWrapReserve(E.numrows + n);
+		return;
+	}
+	if (n > 0) editorWrapReserve(E.numrows + n);
+
+	//the gap moves to at, the rows in between cross it and take their counts along
+	int g = E.wrap_gap, len = E.wrap_cap - E.numrows;
+	for (int r = g - 1; len && r >= at; r--)
+	{
+		int c = E.wrap_lines[r];
+		editorWrapAdd(r + len, c);
+		editorWrapAdd(r, -c);
+	}
+	for (int r = g; len && r < at; r++)
+	{
+		int c = E.wrap_lines[r + len];
+		editorWrapAdd(r, c);
+		editorWrapAdd(r + len, -c);
+	}
+	E.wrap_gap = at;
+	if (n > 0) //taken from the gap, one line each until they're rendered
+	{
+		for (int k = 0; k < n; k++) editorWrapAdd(at + k, 1);
+		E.wrap_gap += n;
+	}
+	else for (int k = at + len; k < at + len - n; k++) editorWrapAdd(k, -E.wrap_lines[k]); //rows at..at-n-1 become gap
+}
+
+void editorWrapSync() //wrap_tree counts lines at this pane's width for every row
+{
+	if (E.wrap_width == E.screencols) return;
+	E.wrap_width = E.screencols;
+	E.wrap_gap = E.numrows; //laid out again with the gap at the end
+	for (int i = 0; i < E.numrows; i++) E.wrap_lines[i] = editorWrapRowLines(&E.row[i]);
+	memset(&E.wrap_lines[E.numrows], 0, sizeof(int) * (E.wrap_cap - E.numrows));
+	editorWrapBuild();
+}
+
+int editorWrapPrefix(int row) //visual lines above row
+{
+	int v = 0;
+	for (int i = editorWrapSlot(row); i > 0; i -= i & -i) v += E.wrap_tree[i];
+	return v;
+}
+
+int editorWrapFind(int v, int *seg) //row holding visual line v, *seg = which of its lines. past the end is the row after the last
+{
+	int pos = 0, step = 1;
+	while (step * 2 <= E.wrap_cap) step *= 2;
+	for (; step; step >>= 1)
+		if (pos + step <= E.wrap_cap && E.wrap_tree[pos + step] <= v)
+		{
+			pos += step;
+			v -= E.wrap_tree[pos];
+		}
+	*seg = pos < E.wrap_cap ? v : 0; //gap slots hold 0, so pos never stops in the gap
+	return pos < E.wrap_gap ? pos : pos - (E.wrap_cap - E.numrows);
+}
+
+int editorWrapTop() //visual line at the top of the pane, after putting rowoff/wrapoff back in range
+{
+	if (E.rowoff > E.numrows) E.rowoff = E.numrows;
+	int lines = editorWrapLines(E.rowoff);
+	if (E.wrapoff >= lines) E.wrapoff = lines - 1; //the row got shorter since
+	if (E.wrapoff < 0) E.wrapoff = 0;
+	return editorWrapPrefix(E.rowoff) + E.wrapoff;
+}
+
+int editorWrapDrawStart(int *seg) //row and line editorDrawRows starts at
+{
+	editorWrapSync();
+	editorWrapTop();
+	*seg = E.wrapoff;
+	return E.rowoff;
+}
+
+void editorWrapScroll() //editorScroll for a wrapped buffer, E.rx is set
+{
+	editorWrapSync();
+	E.coloff = 0;
+	int top = editorWrapTop(), seg = editorWrapSeg(E.cy, E.rx);
+	int cur = editorWrapPrefix(E.cy) + seg;
+	if (cur < top)
+	{
+		E.rowoff = E.cy;
+		E.wrapoff = seg;
+	}
+	else if (cur >= top + E.screenrows) E.rowoff = editorWrapFind(cur - E.screenrows + 1, &E.wrapoff);
+}
+
+void editorWrapCursor(int *y, int *x) //the cursor's spot in the pane
+{
+	editorWrapSync(); //another pane on this buffer may have counted for its width
+	int seg = editorWrapSeg(E.cy, E.rx);
+	*y = editorWrapPrefix(E.cy) + seg - editorWrapTop();
+	*x = E.rx - editorWrapStart(E.cy, seg);
+	if (*x >= E.wrap_width) *x = E.wrap_width - 1;
+}
+
+void editorWrapMove(int key) //arrows move a visual line, page keys a pane of them
+{
+	editorWrapSync();
+	int rx = E.cy < E.numrows ? editorRowCxToRx(&E.row[E.cy], E.cx) : 0;
+	int v = editorWrapPrefix(E.cy) + editorWrapSeg(E.cy, rx), top = editorWrapTop();
+	if (key == ARROW_UP) v--;
+	else if (key == ARROW_DOWN) v++;
+	else if (key == PAGE_UP) v = top - E.screenrows;
+	else v = top + 2 * E.screenrows - 1; //bottom of the pane, then a pane further
+	int total = editorWrapPrefix(E.numrows);
+	if (v < 0) v = 0;
+	if (v > total) v = total;
+
+	int seg;
+	E.cy = editorWrapFind(v, &seg);
+	E.cx = 0;
+	if (E.cy == E.numrows) return;
+	erow *row = &E.row[E.cy];
+	E.cx = editorRowRXtoCX(row, editorWrapStart(E.cy, seg) + E.farx % E.wrap_width); //same column of the line
+	if (seg + 1 < editorWrapLines(E.cy) && editorRowCxToRx(row, E.cx) >= editorWrapStart(E.cy, seg + 1))
+		E.cx = editorRowPrevCluster(row, E.cx); //line broke early before a wide char
+}
+
+void editorWrapToggle() //Ctrl-V
+{
+	if (E.hex)
+	{
+		editorSetStatusMessage("hex lines don't wrap");
+		return;
+	}
+	if (E.wrap)
+	{
+		memFree(MEM_WRAP, E.wrap_lines, sizeof(int) * E.wrap_cap);
+		memFree(MEM_WRAP, E.wrap_tree, sizeof(int) * (E.wrap_cap + 1));
+		E.wrap_lines = E.wrap_tree = NULL;
+		E.wrap = E.wrapoff = E.wrap_cap = E.wrap_width = E.wrap_gap = 0;
+		editorSetStatusMessage("soft wrap off");
+		return;
+	}
+	E.wrap = 1;
+	E.wrap_width = 0; //editorWrapSync counts every row
+	editorWrapReserve(E.numrows);
+	E.wrapoff = E.coloff = 0;
+	editorSetStatusMessage("soft wrap on, Ctrl-V to turn it off");
+}
+
+#pragma endregion
+
+#pragma region /*** Folding ***/
+
+//Ctrl-K closes the function or /* */ block the cursor is in (or opens the fold it's on), Ctrl-U
+//closes every outermost block at once or opens them all. blocks come from the highlighter: a
+//comment runs over the rows hl_open_comment says are open, braces count only outside HL_COMMENT,
+//HL_MLCOMMENT and HL_STRING spans. closed folds only ever nest or sit apart, so the interval tree
+//flattens to the outermost ones in start order, kept as two fenwick trees like the wrap index: the
+//gaps between their starts and the rows each one hides. row -> shown line and back is a descent,
+//O(log folds), and the draw, scroll and cursor code step over a fold in one go however many rows
+//are behind it. rows coming and going add to one gap and one length, the folds inside an outermost
+//one count from its start so only the one being edited has any to move. a fold loses its header and
+//it's gone. the folds belong to the buffer, every pane on it sees them
+
+void editorFoldTreeAdd(int *t, int p, int d) //fenwick add at top p - 1
+{
+	for (; p <= E.fold.ntop; p += p & -p) t[p] += d;
+}
+
+int editorFoldTreeSum(int *t, int p) //fenwick sum of the first p tops
+{
+	int s = 0;
+	for (; p > 0; p -= p & -p) s += t[p];
+	return s;
+}
+
+int editorFoldCount(int row, int *start) //outermost folds starting at or before row, *start = where the last of them does
+{
+	struct editorFolds *f = &E.fold;
+	int pos = 0, sum = 0, step = 1;
+	while (step * 2 <= f->ntop) step *= 2;
+	for (; step; step /= 2)
+		if (pos + step <= f->ntop && sum + f->gtree[pos + step] <= row)
+		{
+			pos += step;
+			sum += f->gtree[pos];
+		}
+	if (start) *start = sum;
+	return pos;
+}
+
+int editorFoldTopAt(int row, editorFold *t) //last outermost fold starting at or before row, -1 = none. *t = its rows
+{
+	int i = editorFoldCount(row, &t->start) - 1;
+	if (i >= 0) t->end = t->start + E.fold.len[i];
+	return i;
+}
+
+int editorFoldShown(int row) //the row on screen for row: itself, or the header of the fold it's behind
+{
+	editorFold t;
+	return editorFoldTopAt(row, &t) >= 0 && row <= t.end ? t.start : row;
+}
+
+int editorFoldHeader(int row) //rows hidden behind row, 0 = it doesn't head a closed fold
+{
+	editorFold t;
+	return editorFoldTopAt(row, &t) >= 0 && t.start == row ? t.end - row : 0;
+}
+
+int editorFoldLine(int row) //shown line of row, a hidden row is on its header's
+{
+	editorFold t;
+	int i = editorFoldTopAt(row, &t);
+	if (i < 0) return row;
+	int hid = editorFoldTreeSum(E.fold.ltree, i + 1);
+	if (row <= t.end) return t.start - hid;
+	return row - hid - (t.end - t.start);
+}
+
+int editorFoldRow(int v) //row on shown line v, past the end is the row after the last
+{
+	if (v < 0) v = 0;
+	struct editorFolds *f = &E.fold;
+	int pos = 0, start = 0, hid = 0, step = 1; //folds with their header on v or above
+	while (step * 2 <= f->ntop) step *= 2;
+	for (; step; step /= 2)
+		if (pos + step <= f->ntop && start + f->gtree[pos + step] - hid - f->ltree[pos + step] <= v)
+		{
+			pos += step;
+			start += f->gtree[pos];
+			hid += f->ltree[pos];
+		}
+	int row = v;
+	if (pos > 0) row = v == start - hid ? start : v + hid + f->len[pos - 1];
+	return row < E.numrows ? row : E.numrows;
+}
+
+int editorFoldNext(int row) //row below, past a closed fold
+{
+	return row + editorFoldHeader(row) + 1;
+}
+
+int editorFoldPrev(int row) //row above, a closed fold's header rather than its last row
+{
+	return row > 0 ? editorFoldShown(row - 1) : 0;
+}
+
+void editorFoldIndex() //outermost folds and their trees from all, which then counts from each one's start
+{
+	struct editorFolds *f = &E.fold;
+	if (f->n > f->topcap)
+	{
+		int cap = f->topcap ? f->topcap : 16, old = f->topcap;
+		while (cap < f->n) cap *= 2;
+		f->first = memRealloc(MEM_FOLD, f->first, old ? sizeof(int) * (old + 1) : 0, sizeof(int) * (cap + 1));
+		f->gap = memRealloc(MEM_FOLD, f->gap, sizeof(int) * old, sizeof(int) * cap);
+		f->len = memRealloc(MEM_FOLD, f->len, sizeof(int) * old, sizeof(int) * cap);
+		f->gtree = memRealloc(MEM_FOLD, f->gtree, old ? sizeof(int) * (old + 1) : 0, sizeof(int) * (cap + 1));
+		f->ltree = memRealloc(MEM_FOLD, f->ltree, old ? sizeof(int) * (old + 1) : 0, sizeof(int) * (cap + 1));
+		f->topcap = cap;
+	}
+	int start = 0, end = -1;
+	f->ntop = 0;
+	for (int k = 0; k < f->n; k++)
+	{
+		editorFold *a = &f->all[k];
+		if (!f->ntop || a->start > end) //a new outermost one, otherwise it's inside the last one or running past it
+		{
+			if (f->ntop) f->len[f->ntop - 1] = end - start;
+			f->first[f->ntop] = k;
+			f->gap[f->ntop++] = a->start - start;
+			start = a->start;
+		}
+		if (a->end > end) end = a->end;
+		a->start -= start;
+		a->end -= start;
+	}
+	if (f->ntop) f->len[f->ntop - 1] = end - start;
+	f->first[f->ntop] = f->n;
+
+	memset(f->gtree, 0, sizeof(int) * (f->ntop + 1));
+	memset(f->ltree, 0, sizeof(int) * (f->ntop + 1));
+	for (int p = 1; p <= f->ntop; p++)
+	{
+		f->gtree[p] += f->gap[p - 1];
+		if (p > 1) f->ltree[p] += f->len[p - 2]; //hidden above top p - 1 = the lens before it
+		int q = p + (p & -p);
+		if (q > f->ntop) continue;
+		f->gtree[q] += f->gtree[p];
+		f->ltree[q] += f->ltree[p];
+	}
+}
+
+void editorFoldFlatten() //all back to rows in start order, deleted ones dropped. editorFoldIndex has to follow
+{
+	struct editorFolds *f = &E.fold;
+	int k = 0, start = 0;
+	for (int i = 0; i < f->ntop; i++)
+	{
+		start += f->gap[i];
+		for (int j = f->first[i]; j < f->first[i + 1]; j++)
+		{
+			if (f->all[j].end < 0) continue; //its header was deleted
+			f->all[k].start = start + f->all[j].start;
+			f->all[k++].end = start + f->all[j].end;
+		}
+	}
+	if (f->ntop) f->n = k;
+	f->ntop = 0;
+}
+
+void editorFoldChanged(int from, int to) //rows from..to were hidden or shown, editorFoldRewrap recounts their wrap lines
+{
+	struct editorFolds *f = &E.fold;
+	if (to < from) return;
+	if (f->shown_end <= f->shown_from) f->shown_from = from, f->shown_end = to + 1;
+	if (from < f->shown_from) f->shown_from = from;
+	if (to >= f->shown_end) f->shown_end = to + 1;
+}
+
+void editorFoldRewrap() //the rows editorFoldChanged saw, once they're in place
+{
+	struct editorFolds *f = &E.fold;
+	if (E.wrap && E.wrap_width)
+		for (int i = f->shown_from; i < f->shown_end && i < E.numrows; i++) editorWrapRow(&E.row[i]);
+	f->shown_from = f->shown_end = 0;
+}
+
+void editorFoldAdd(int start, int end) //into all, flattened
+{
+	struct editorFolds *f = &E.fold;
+	if (f->n == f->cap)
+	{
+		int cap = f->cap ? f->cap * 2 : 16;
+		f->all = memRealloc(MEM_FOLD, f->all, sizeof(editorFold) * f->cap, sizeof(editorFold) * cap);
+		f->cap = cap;
+	}
+	int lo = 0, hi = f->n; //after the ones starting at or before it
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (f->all[mid].start <= start) lo = mid + 1;
+		else hi = mid;
+	}
+	memmove(&f->all[lo + 1], &f->all[lo], sizeof(editorFold) * (f->n - lo));
+	f->all[lo].start = start;
+	f->all[lo].end = end;
+	f->n++;
+}
+
+void editorFoldSlide(int i, int n) //outermost folds from i on move n rows
+{
+	struct editorFolds *f = &E.fold;
+	if (i >= f->ntop) return;
+	f->gap[i] += n;
+	editorFoldTreeAdd(f->gtree, i + 1, n);
+}
+
+void editorFoldMove(int i, int start) //top i starts at start now, the ones after it stay put
+{
+	int d = start - editorFoldTreeSum(E.fold.gtree, i + 1);
+	editorFoldSlide(i, d);
+	editorFoldSlide(i + 1, -d);
+}
+
+void editorFoldResize(int i, int len) //top i hides len rows now, 0 = it's gone
+{
+	struct editorFolds *f = &E.fold;
+	editorFoldTreeAdd(f->ltree, i + 2, len - f->len[i]);
+	f->len[i] = len;
+}
+
+int editorFoldCut(int i, int r, int rl, int apply) //rows r..rl of top i (counted from its start, r > 0) removed: rows it hides after, -1 = its folds don't make one fold from its header any more
+{
+	struct editorFolds *f = &E.fold;
+	int m = rl - r + 1, end = 0;
+	for (int j = f->first[i]; j < f->first[i + 1]; j++)
+	{
+		editorFold a = f->all[j];
+		if (a.end < 0) continue;
+		if (a.start > rl) a.start -= m, a.end -= m;
+		else if (a.start >= r) a.end = -1; //header removed
+		else if (a.end >= r)
+		{
+			a.end = a.end > rl ? a.end - m : r - 1;
+			if (a.end <= a.start) a.end = -1;
+		}
+		if (a.end >= 0 && a.start > end) return -1; //lost the one between, or the header's own
+		if (a.end > end) end = a.end;
+		if (apply) f->all[j] = a;
+	}
+	return end;
+}
+
+void editorFoldShift(int at, int n) //n rows inserted at at (n < 0: removed), before numrows changes
+{
+	struct editorFolds *f = &E.fold;
+	if (!f->ntop) return;
+	int s, i = editorFoldCount(at - 1, &s) - 1; //last outermost fold starting above at
+	int in = i >= 0 && s + f->len[i] >= at; //at is behind it
+	if (n > 0)
+	{
+		if (in) //went in behind the header, hidden with the rest
+		{
+			for (int j = f->first[i]; j < f->first[i + 1]; j++)
+			{
+				editorFold *a = &f->all[j];
+				if (a->end < 0) continue;
+				if (a->start >= at - s) a->start += n, a->end += n;
+				else if (a->end >= at - s) a->end += n;
+			}
+			editorFoldResize(i, f->len[i] + n);
+		}
+		editorFoldSlide(i + 1, n);
+		return;
+	}
+
+	int last = at - n - 1, end = in ? s + f->len[i] : -1; //last row removed, last one hidden by a fold that loses rows
+	int q = editorFoldCount(last, NULL), cut = in ? editorFoldCut(i, at - s, last - s, 0) : 0, ok = cut >= 0;
+	for (int t = i + 1, start = s; t < q; t++) //the ones starting in the removed rows go, unless something inside them starts after
+	{
+		start += f->gap[t];
+		if (start + f->len[t] > end) end = start + f->len[t];
+		for (int j = f->first[t]; ok && j < f->first[t + 1]; j++)
+			if (f->all[j].end >= 0 && start + f->all[j].start > last) ok = 0;
+	}
+	end = end > last ? end + n : at - 1; //where that row ends up
+	if (!ok) //nested folds come apart, from the rows up
+	{
+		editorFoldChanged(in ? s + 1 : at, end);
+		editorFoldFlatten();
+		int k = 0;
+		for (int j = 0; j < f->n; j++)
+		{
+			editorFold a = f->all[j];
+			if (a.start > last) a.start += n, a.end += n;
+			else if (a.start >= at) continue; //header removed
+			else if (a.end >= at)
+			{
+				a.end = a.end > last ? a.end + n : at - 1;
+				if (a.end <= a.start) continue;
+			}
+			f->all[k++] = a;
+		}
+		f->n = k;
+		editorFoldIndex();
+		return;
+	}
+	if (in)
+	{
+		int old = s + f->len[i];
+		editorFoldChanged(s + cut + 1, old > last ? old + n : at - 1); //a fold inside it went and took its rows out
+		editorFoldCut(i, at - s, last - s, 1);
+		editorFoldResize(i, cut);
+	}
+	if (q > i + 1) editorFoldChanged(at, end); //what the ones that went hid below the removed rows
+	for (int t = i + 1; t < q; t++) //emptied, they sit on at until the next editorFoldIndex
+	{
+		for (int j = f->first[t]; j < f->first[t + 1]; j++) f->all[j].end = -1;
+		editorFoldResize(t, 0);
+		editorFoldMove(t, at);
+	}
+	editorFoldSlide(q, n);
+}
+
+void editorFoldOpen(int row) //open every fold row is hidden behind
+{
+	struct editorFolds *f = &E.fold;
+	editorFoldFlatten();
+	int k = 0;
+	for (int i = 0; i < f->n; i++)
+	{
+		editorFold a = f->all[i];
+		if (a.start >= row || a.end < row) f->all[k++] = a;
+		else editorFoldChanged(a.start, a.end);
+	}
+	f->n = k;
+	editorFoldIndex();
+	editorFoldRewrap();
+}
+
+void editorFoldReveal() //a cursor that ended up behind a fold (find, undo, grep) opens it, the top row is always one shown
+{
+	if (editorFoldShown(E.cy) != E.cy) editorFoldOpen(E.cy);
+	E.rowoff = editorFoldShown(E.rowoff);
+}
+
+void editorFoldScroll() //editorScroll's vertical part by shown lines
+{
+	int cur = editorFoldLine(E.cy), top = editorFoldLine(E.rowoff);
+	if (cur < top) E.rowoff = E.cy;
+	else if (cur >= top + E.screenrows) E.rowoff = editorFoldRow(cur - E.screenrows + 1);
+}
+
+void editorFoldSurface() //cursor onto the header of a fold it's behind, for panes that didn't close it themselves
+{
+	E.cy = editorFoldShown(E.cy);
+	if (E.cy < E.numrows && E.cx > E.row[E.cy].size) E.cx = E.row[E.cy].size;
+}
+
+void editorFoldBraces(erowdraw *row, int *opens, int *closes) //{} row leaves open and ones closing something above
+{
+	brsum b;
+	editorBracketSum(row, &b);
+	*opens = b.open[2];
+	*closes = b.close[2];
+}
+
+int editorFoldBlockEnd(int row) //last row of the /* */ or {} block that opens on row, row itself = none
+{
+	if (E.row[row].hl_open_comment && (row == 0 || !E.row[row - 1].hl_open_comment)) //to the row the comment closes on
+	{
+		int j = row + 1;
+		while (j < E.numrows && E.row[j].hl_open_comment) j++;
+		return j < E.numrows ? j : E.numrows - 1;
+	}
+	int depth, opens, closes;
+	editorFoldBraces(&E.rowdraw[row], &depth, &closes);
+	if (!depth) return row;
+	for (int j = row + 1; j < E.numrows; j++)
+	{
+		editorFoldBraces(&E.rowdraw[j], &opens, &closes);
+		if (closes >= depth) return j;
+		depth += opens - closes;
+	}
+	return E.numrows - 1; //never closed
+}
+
+int editorFoldEnclosing(int row) //first row of the innermost block row is inside, -1 = none
+{
+	if (row > 0 && E.row[row - 1].hl_open_comment) //in a comment, back up to where it opens
+	{
+		while (row > 0 && E.row[row - 1].hl_open_comment) row--;
+		return row;
+	}
+	return editorBracketOpener(row, 2); //the nearest { above still open at row, O(log n) in the bracket index
+}
+
+void editorFoldToggle() //Ctrl-K
+{
+	if (E.hex)
+	{
+		editorSetStatusMessage("hex view doesn't fold");
+		return;
+	}
+	if (E.cy >= E.numrows) return;
+	int hidden = editorFoldHeader(E.cy);
+	if (hidden)
+	{
+		struct editorFolds *f = &E.fold;
+		int k = 0;
+		editorFoldFlatten();
+		for (int i = 0; i < f->n; i++) if (f->all[i].start != E.cy) f->all[k++] = f->all[i]; //ones inside stay closed
+		f->n = k;
+		editorFoldIndex();
+		editorFoldChanged(E.cy, E.cy + hidden);
+		editorFoldRewrap();
+		editorSetStatusMessage("opened %d lines", hidden);
+		return;
+	}
+	editorHlFlush(); //braces in strings and comments only stop counting once their rows are highlighted
+	int start = E.cy, end = editorFoldBlockEnd(start);
+	if (end <= start && (start = editorFoldEnclosing(E.cy)) >= 0) end = editorFoldBlockEnd(start);
+	if (start < 0 || end <= start)
+	{
+		editorSetStatusMessage("nothing to fold here");
+		return;
+	}
+	editorFoldFlatten();
+	editorFoldAdd(start, end);
+	editorFoldIndex();
+	editorFoldChanged(start, end);
+	editorFoldRewrap();
+	editorFoldSurface();
+	editorSetStatusMessage("folded %d lines, Ctrl-K on it opens them", end - start);
+}
+
+void editorFoldAll() //Ctrl-U, close every outermost block or open everything
+{
+	if (E.hex)
+	{
+		editorSetStatusMessage("hex view doesn't fold");
+		return;
+	}
+	if (E.wrap) E.wrap_width = 0; //every row's lines, recount
+	editorFoldFlatten();
+	if (E.fold.n)
+	{
+		E.fold.n = 0;
+		editorFoldIndex();
+		editorSetStatusMessage("all folds open");
+		return;
+	}
+	editorHlFlush();
+	for (int row = 0; row < E.numrows; row++)
+	{
+		int end = editorFoldBlockEnd(row);
+		if (end <= row) continue;
+		editorFoldAdd(row, end);
+		row = end;
+	}
+	editorFoldIndex();
+	editorFoldSurface();
+	editorSetStatusMessage("%d folds, Ctrl-U opens them all", E.fold.n);
+}
+
+#pragma endregion
+
+#pragma region /*** Brackets ***/
+
+//the bracket under the cursor (or just before it) and its partner are drawn inverted, Ctrl-] jumps
+//to the partner. brackets in HL_COMMENT, HL_MLCOMMENT and HL_STRING spans don't count, and each
+//kind pairs only with itself. every row is boiled down to a brsum, what's left of its brackets once
+//the pairs inside it cancel: closes first, then opens. brsums of neighbours join the same way, so a
+//segment tree over the rows finds the row holding a partner 200k rows away in O(log n) descents,
+//then only that row is scanned. a row whose spans change updates its leaf and the nodes above it;
+//rows coming or going slide the leaves between the gap and the edit across it and redo only the
+//nodes over the leaves that changed. nothing is built until a bracket is first looked at
+
+const char brk_kinds[] = "([{)]}"; //opens then closes, kind = index % 3
+
+int editorBracketKind(char c) //index in brk_kinds, -1 = not a bracket
+{
+	switch (c)
+	{
+		case '(': return 0;
+		case '[': return 1;
+		case '{': return 2;
+		case ')': return 3;
+		case ']': return 4;
+		case '}': return 5;
+		default: return -1;
+	}
+}
+
+int editorBracketSkip(erowdraw *row, hlspan **sp, int j) //render[j] is in a string or comment. *sp walks forward with j
+{
+	hlspan *end = row->hl + row->nhl;
+	while (*sp < end && (*sp)->off + (*sp)->len <= j) (*sp)++;
+	if (*sp >= end || (*sp)->off > j) return 0;
+	return (*sp)->hl == HL_COMMENT || (*sp)->hl == HL_MLCOMMENT || (*sp)->hl == HL_STRING;
+}
+
+void editorBracketSum(erowdraw *row, brsum *s) //row's brackets after the pairs in it cancel
+{
+	hlspan *sp = row->hl;
+	memset(s, 0, sizeof(*s));
+	for (int j = 0; j < row->rsize; j++)
+	{
+		int k = editorBracketKind(row->render[j]);
+		if (k < 0 || editorBracketSkip(row, &sp, j)) continue;
+		int t = k % 3;
+		if (k < 3) s->open[t]++;
+		else if (s->open[t]) s->open[t]--;
+		else s->close[t]++;
+	}
+}
+
+void editorBracketJoin(brsum *r, const brsum *a, const brsum *b) //r = a followed by b
+{
+	for (int t = 0; t < 3; t++)
+	{
+		int m = a->open[t] < b->close[t] ? a->open[t] : b->close[t]; //a's opens b closes
+		r->close[t] = a->close[t] + b->close[t] - m;
+		r->open[t] = a->open[t] - m + b->open[t];
+	}
+}
+
+void editorBracketFree() //drop the index, the rows are going
+{
+	memFree(MEM_BRACKET, E.brk.tree, sizeof(brsum) * 2 * E.brk.size);
+	memset(&E.brk, 0, sizeof(E.brk));
+	E.brk.from = INT_MAX;
+}
+
+int editorBracketLeaf(int row) //leaf index of row
+{
+	return row < E.brk.gap ? row : row + E.brk.size - E.numrows;
+}
+
+void editorBracketRejoin(int from, int to) //leaves from..to moved, the nodes above them are redone now
+{
+	if (from > to || (from >= E.brk.from && to <= E.brk.to)) return; //the next lookup redoes them anyway
+	brsum *t = E.brk.tree;
+	for (int lo = (E.brk.size + from) / 2, hi = (E.brk.size + to) / 2; lo; lo /= 2, hi /= 2)
+		for (int k = lo; k <= hi; k++) editorBracketJoin(&t[k], &t[2 * k], &t[2 * k + 1]);
+}
+
+void editorBracketBuild(int size) //index at least size rows with the gap at the end, everything redone
+{
+	int n = 64;
+	while (n < size) n *= 2;
+	brsum *t = memRealloc(MEM_BRACKET, NULL, 0, sizeof(brsum) * 2 * n);
+	memset(t, 0, sizeof(brsum) * 2 * n);
+	if (E.brk.size) //outgrown, the leaves are still good
+	{
+		brsum *leaf = &E.brk.tree[E.brk.size];
+		memcpy(&t[n], leaf, sizeof(brsum) * E.brk.gap);
+		memcpy(&t[n + E.brk.gap], &leaf[editorBracketLeaf(E.brk.gap)], sizeof(brsum) * (E.numrows - E.brk.gap));
+	}
+	else for (int i = 0; i < E.numrows; i++) editorBracketSum(&E.rowdraw[i], &t[n + i]);
+	editorBracketFree();
+	E.brk.tree = t;
+	E.brk.size = n;
+	E.brk.gap = E.numrows;
+	E.brk.from = 0;
+	E.brk.to = n - 1;
+}
+
+void editorBracketRow(erow *row) //row's spans changed
+{
+	int i = row - E.row;
+	if (!E.brk.size || i < 0 || i >= E.numrows) return;
+	brsum *t = E.brk.tree;
+	int k = editorBracketLeaf(i);
+	editorBracketSum(&E.rowdraw[i], &t[E.brk.size + k]);
+	if (k >= E.brk.from && k <= E.brk.to) return; //redone with the rest
+	for (k = (E.brk.size + k) / 2; k; k /= 2) editorBracketJoin(&t[k], &t[2 * k], &t[2 * k + 1]);
+}
+
+void editorBracketShift(int at, int n) //n rows inserted at at (n < 0: removed), before numrows changes
+{
+	if (!E.brk.size) return;
+	if (E.numrows + n > E.brk.size) editorBracketBuild(E.numrows + n);
+
+	//the gap moves to at, only the leaves in between cross it. the empty leaves they cross over
+	//stay empty, so a jump of a few rows redoes a few leaves' nodes however wide the gap is
+	brsum *leaf = &E.brk.tree[E.brk.size];
+	int g = E.brk.gap, len = E.brk.size - E.numrows;
+	if (at < g)
+	{
+		int m = g - at, z = len < m ? len : m; //rows moving right, leaves they leave empty
+		memmove(&leaf[at + len], &leaf[at], sizeof(brsum) * m);
+		memset(&leaf[at], 0, sizeof(brsum) * z);
+		if (m <= len) editorBracketRejoin(at, at + z - 1); //zeroed and moved apart
+		editorBracketRejoin(m <= len ? at + len : at, g + len - 1);
+	}
+	else if (at > g)
+	{
+		int m = at - g, z = len < m ? len : m; //rows moving left
+		memmove(&leaf[g], &leaf[g + len], sizeof(brsum) * m);
+		memset(&leaf[at + len - z], 0, sizeof(brsum) * z);
+		if (m <= len) editorBracketRejoin(at + len - z, at + len - 1);
+		editorBracketRejoin(g, m <= len ? at - 1 : at + len - 1);
+	}
+	E.brk.gap = at;
+	if (n > 0) E.brk.gap += n; //taken from the gap, summed when they're highlighted
+	else //rows at..at-n-1 become gap
+	{
+		memset(&leaf[at + len], 0, sizeof(brsum) * -n);
+		editorBracketRejoin(at + len, at + len - n - 1);
+	}
+}
+
+void editorBracketSync() //nodes over the stale leaves, from their children
+{
+	if (!E.brk.size) editorBracketBuild(E.numrows);
+	if (E.brk.from > E.brk.to) return;
+	brsum *t = E.brk.tree;
+	for (int lo = (E.brk.size + E.brk.from) / 2, hi = (E.brk.size + E.brk.to) / 2; lo; lo /= 2, hi /= 2)
+		for (int k = lo; k <= hi; k++) editorBracketJoin(&t[k], &t[2 * k], &t[2 * k + 1]);
+	E.brk.from = INT_MAX;
+	E.brk.to = -1;
+}
+
+int editorBracketFwd(int k, int lo, int hi, int start, int t, int *d) //first leaf from start on that closes the d-th pending open of kind t, node k covers leaves lo..hi-1. -1 = none
+{
+	brsum *s = &E.brk.tree[k];
+	if (hi <= start) return -1;
+	if (lo >= start && s->close[t] < *d) //all of it falls short, what it leaves open adds up
+	{
+		*d += s->open[t] - s->close[t];
+		return -1;
+	}
+	if (hi - lo == 1) return lo;
+	int mid = (lo + hi) / 2, j = editorBracketFwd(2 * k, lo, mid, start, t, d);
+	return j >= 0 ? j : editorBracketFwd(2 * k + 1, mid, hi, start, t, d);
+}
+
+int editorBracketBack(int k, int lo, int hi, int end, int t, int *d) //last leaf at or before end that opens the d-th pending close of kind t. -1 = none
+{
+	brsum *s = &E.brk.tree[k];
+	if (lo > end) return -1;
+	if (hi - 1 <= end && s->open[t] < *d)
+	{
+		*d += s->close[t] - s->open[t];
+		return -1;
+	}
+	if (hi - lo == 1) return lo;
+	int mid = (lo + hi) / 2, j = editorBracketBack(2 * k + 1, mid, hi, end, t, d);
+	return j >= 0 ? j : editorBracketBack(2 * k, lo, mid, end, t, d);
+}
+
+int editorBracketScan(erowdraw *row, int from, int dir, int t, int *d) //walk row from render[from] by dir until *d brackets of kind t are matched. -1 = ran off the end, *d = still pending
+{
+	int s = editorHlSpanAt(row, from);
+	for (int j = from; j >= 0 && j < row->rsize; j += dir)
+	{
+		char c = row->render[j];
+		if (c != brk_kinds[t] && c != brk_kinds[t + 3]) continue;
+		while (dir < 0 && s >= 0 && row->hl[s].off > j) s--; //span at or before j
+		while (dir > 0 && s + 1 < row->nhl && row->hl[s + 1].off <= j) s++;
+		if (s >= 0 && j < row->hl[s].off + row->hl[s].len)
+		{
+			int hl = row->hl[s].hl;
+			if (hl == HL_COMMENT || hl == HL_MLCOMMENT || hl == HL_STRING) continue;
+		}
+		if ((c == brk_kinds[t]) == (dir > 0)) (*d)++; //another one the same way
+		else if (--*d == 0) return j;
+	}
+	return -1;
+}
+
+int editorBracketMatch(int row, int ri, int *mrow, int *mri) //partner of the bracket at render[ri] of row. 0 = none
+{
+	erowdraw *r = &E.rowdraw[row];
+	int k = editorBracketKind(r->render[ri]), t = k % 3, dir = k < 3 ? 1 : -1, d = 1;
+	int j = editorBracketScan(r, ri + dir, dir, t, &d), m = row; //same row first
+	if (j < 0)
+	{
+		if (dir > 0 ? row + 1 >= E.numrows : row == 0) return 0;
+		editorBracketSync();
+		m = dir > 0 ? editorBracketFwd(1, 0, E.brk.size, editorBracketLeaf(row + 1), t, &d) : editorBracketBack(1, 0, E.brk.size, editorBracketLeaf(row - 1), t, &d);
+		if (m < 0) return 0;
+		if (m >= E.brk.gap) m -= E.brk.size - E.numrows; //leaf -> row, the gap's leaves are empty so it never lands in it
+		j = editorBracketScan(&E.rowdraw[m], dir > 0 ? 0 : E.rowdraw[m].rsize - 1, dir, t, &d);
+		if (j < 0) return 0;
+	}
+	*mrow = m;
+	*mri = j;
+	return 1;
+}
+
+int editorBracketOpener(int row, int t) //last row above row that leaves a kind t bracket open past it, -1 = none
+{
+	if (row <= 0) return -1;
+	editorBracketSync();
+	int d = 1, m = editorBracketBack(1, 0, E.brk.size, editorBracketLeaf(row - 1), t, &d);
+	if (m >= E.brk.gap) m -= E.brk.size - E.numrows;
+	return m;
+}
+
+int editorBracketAt() //render pos of the bracket under the cursor, else the one just before it. -1 = none
+{
+	if (E.hex || E.grep_view || E.cy >= E.numrows) return -1;
+	erowdraw *d = &E.rowdraw[E.cy];
+	int ri = editorRowCxToRi(&E.row[E.cy], E.cx);
+	for (int j = ri; j >= 0 && j >= ri - 1; j--)
+	{
+		hlspan *sp = d->hl;
+		if (j < d->rsize && editorBracketKind(d->render[j]) >= 0 && !editorBracketSkip(d, &sp, j)) return j;
+	}
+	return -1;
+}
+
+void editorBracketPair() //what editorDrawRows shows inverted this frame
+{
+	int ri = editorBracketAt();
+	E.pair_row[0] = E.pair_row[1] = -1;
+	if (ri < 0 || !editorBracketMatch(E.cy, ri, &E.pair_row[1], &E.pair_at[1])) return;
+	E.pair_row[0] = E.cy;
+	E.pair_at[0] = ri;
+}
+
+void editorBracketJump() //Ctrl-]
+{
+	editorHlFlush(); //brackets in strings and comments only stop counting once their rows are highlighted
+	int ri = editorBracketAt(), row, at;
+	if (ri < 0)
+	{
+		editorSetStatusMessage("no bracket at the cursor");
+		return;
+	}
+	if (!editorBracketMatch(E.cy, ri, &row, &at))
+	{
+		editorSetStatusMessage("no match for %c", E.rowdraw[E.cy].render[ri]);
+		return;
+	}
+	E.cy = row;
+	E.cx = editorRowWalk(&E.row[row], offsetof(erowcp, ri), at, NULL, NULL);
+	editorSetFarx();
+}
+
+#pragma endregion
+
+#pragma region /***file i/o ***/
+//Editor Open/Save
+/* Description: User Input: filename File operations: find file with name and open Printing: Copy first line into erow.*/
+int editorOpen(char *filename){ //-1 = couldn't read it, the buffer is left empty with no name and not loaded
+	FILE *fp = fopen(filename, "r"); //attempts to open the passed in filename
+	if (!fp)
+	{
+		editorSetStatusMessage("can't open %s: %s", filename, strerror(errno));
+		free(E.filename); //a save mustn't write the empty buffer over it
+		E.filename = NULL;
+		E.syntax = NULL;
+		E.hex_want = 0;
+		if (E.curbuf >= 0) E.bufs[E.curbuf].loaded = 0; //switching back tries again
+		return -1;
+	}
+
+	free(E.filename); //ensure blank filename to rewrite
+	E.filename = strdup(filename); //copy filename into editor object (needs the feature macros above the includes)
+	editorSelectSyntaxHighlight(); //setup syntax HL for file 
+
+	E.undo_suspended++; //loading isn't an edit
+	E.hl_defer++; //the worker colors it in after
+	E.cache_hit = 0;
+	E.gzip = 0;
+	int hex = E.hex_want;
+	E.hex_want = 0;
+
+	struct stat st;
+	char *map = MAP_FAILED;
+	if (fstat(fileno(fp), &st) == 0)
+	{
+		E.disk_size = st.st_size;
+		E.disk_dev = st.st_dev;
+		E.disk_ino = st.st_ino;
+		E.disk_mtime = st.st_mtim;
+		if (S_ISREG(st.st_mode) && st.st_size > 0) map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	}
+	if (map != MAP_FAILED) //regular file, split it straight out of the mapping (or take the cached split)
+	{
+		E.gzip = editorGzipMagic(map, st.st_size);
+		if (!E.gzip && (hex > 0 || (hex == 0 && editorHexLooksBinary(map, st.st_size)))) editorHexStart((unsigned char *)map, st.st_size); //keeps the mapping
+		else
+		{
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			if (E.gzip) editorGzipSplit(map, st.st_size); //no cache, its line index is offsets into the file
+			else E.cache_hit = editorCacheLoad(map, &st);
+			if (!E.gzip && !E.cache_hit) editorSplitRows(map, st.st_size);
+			munmap(map, st.st_size);
+		}
+	}
+
+	char *line = NULL; //line holder var
+	size_t linecap = 0; //max amount to readin
+	ssize_t linelen; //length read into line
+	
+	while(map == MAP_FAILED && (linelen = getline(&line, &linecap, fp)) != -1){ //pipes and such
+		//decrement till linelen only includes characters before end of line
+		while(linelen > 0 //make sure line has content
+		&& (line[linelen - 1] == '\n' //curchar not a newline
+		|| line[linelen -1] == '\r')) //curchar not a return 
+		{
+			linelen--; //decrement index till not \n\r
+		}
+		editorInsertRow(E.numrows, line, linelen); //insert written row into numrows object
+	}
+
+	free(line); //free line holding var
+	fclose(fp); //close file
+	E.undo_suspended--;
+	E.hl_defer--;
+	E.dirty = 0; //set dirty flags to 0 since file just opened
+	editorDiskHashRows(0); //what a reload merges against
+	return 0;
+}
+
+void editorSave(){
+	if (E.filename == NULL) //If filename null go here
+	{		
+		if ((E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL)) == NULL) //prompt them to enter filename 
+		{
+			editorSetStatusMessage("Save Aborted"); //no filename so no save
+			return;
+		}
+		editorSelectSyntaxHighlight();
+	} 
+
+	int fd; 
+	int len;
+	char *buf = editorRowsToString(&len); //big buf to store all content from editor
+	if (E.gzip)
+	{
+		editorGzipSave(buf, len); //compressed and written on a thread
+		return;
+	}
+
+	if ((fd = open(E.filename, O_CREAT | O_RDWR,  0644)) == -1) goto esEnd; //open file, create if doesn't exist
+	if (ftruncate(fd, len) == -1) goto esEnd; //truncate to length of content needed to write
+	if (write(fd, buf, len) != len) goto esEnd; //write all content from buf onto file
+	struct stat st;
+	if (fstat(fd, &st) == 0)
+	{
+		E.disk_size = st.st_size;
+		E.disk_dev = st.st_dev;
+		E.disk_ino = st.st_ino;
+		E.disk_mtime = st.st_mtim;
+	}
 	close(fd); 
+	editorDiskHashRows(0);
 	free(buf);
 	E.dirty = 0; //no more dirty flags
+	E.cache_hit = 0; //new content, new cache
+	editorCacheStore();
 	editorSetStatusMessage("%d bytes written to disk", len); //closing message
 	return;
 
-esEnd:
-	close(fd);
-	free(buf);
+esEnd:;
+	int err = errno; //before close can touch it
+	if (fd != -1) close(fd);
+	free(buf);
+	editorSetStatusMessage("can't save %s: %s", E.filename, strerror(err)); //still dirty, quitting asks first
+	return;
+}
+
+#pragma endregion
+
+#pragma region /*** Buffers ***/
+
+//kilo a b c registers one buffer per file and only loads a file the first time it's switched to.
+//the buffer being edited lives in E like it always has, the others keep their part of E in their
+//editorBuffer until they're switched back in. Ctrl-N/Ctrl-B cycle, Ctrl-O switches by number or
+//name (or adds a buffer for a new path), Ctrl-O with nothing typed lists them in the message bar
+
+void editorBufferStash(struct editorBufferState *st) //E's per buffer part -> st
+{
+	st->cx = E.cx; st->cy = E.cy; st->rx = E.rx; st->farx = E.farx;
+	st->rowoff = E.rowoff; st->coloff = E.coloff;
+	st->numrows = E.numrows; st->rowcap = E.rowcap; st->row = E.row; st->rowdraw = E.rowdraw;
+	st->arena = E.arena;
+	st->dirty = E.dirty;
+	st->undo = E.undo; st->undolen = E.undolen; st->undocap = E.undocap;
+	st->hl_from = E.hl_from; st->hl_nstale = E.hl_nstale;
+	st->cache_hit = E.cache_hit;
+	st->filename = E.filename; st->syntax = E.syntax;
+	st->grep_view = E.grep_view; st->grep_sel = E.grep_sel;
+	st->match_row = E.match_row; st->match_at = E.match_at; st->match_len = E.match_len;
+	st->disk_size = E.disk_size; st->disk_dev = E.disk_dev; st->disk_ino = E.disk_ino;
+	st->disk_mtime = E.disk_mtime; st->disk_hash = E.disk_hash; st->disk_lines = E.disk_lines; st->gzip = E.gzip;
+	st->hex = E.hex; st->hex_size = E.hex_size; st->hex_width = E.hex_width;
+	st->wrap = E.wrap; st->wrapoff = E.wrapoff; st->wrap_lines = E.wrap_lines; st->wrap_tree = E.wrap_tree;
+	st->wrap_cap = E.wrap_cap; st->wrap_width = E.wrap_width; st->wrap_gap = E.wrap_gap;
+	st->fold = E.fold; st->brk = E.brk;
+	st->follow = E.follow; st->follow_wd = E.follow_wd; st->follow_dwd = E.follow_dwd; st->follow_partial = E.follow_partial;
+}
+
+void editorBufferRestore(struct editorBufferState *st) //st -> E's per buffer part
+{
+	E.cx = st->cx; E.cy = st->cy; E.rx = st->rx; E.farx = st->farx;
+	E.rowoff = st->rowoff; E.coloff = st->coloff;
+	E.numrows = st->numrows; E.rowcap = st->rowcap; E.row = st->row; E.rowdraw = st->rowdraw;
+	E.arena = st->arena;
+	E.dirty = st->dirty;
+	E.undo = st->undo; E.undolen = st->undolen; E.undocap = st->undocap;
+	E.hl_from = st->hl_from; E.hl_nstale = st->hl_nstale;
+	E.cache_hit = st->cache_hit;
+	E.filename = st->filename; E.syntax = st->syntax;
+	E.grep_view = st->grep_view; E.grep_sel = st->grep_sel;
+	E.match_row = st->match_row; E.match_at = st->match_at; E.match_len = st->match_len;
+	E.disk_size = st->disk_size; E.disk_dev = st->disk_dev; E.disk_ino = st->disk_ino;
+	E.disk_mtime = st->disk_mtime; E.disk_hash = st->disk_hash; E.disk_lines = st->disk_lines; E.gzip = st->gzip;
+	E.hex = st->hex; E.hex_size = st->hex_size; E.hex_width = st->hex_width;
+	E.wrap = st->wrap; E.wrapoff = st->wrapoff; E.wrap_lines = st->wrap_lines; E.wrap_tree = st->wrap_tree;
+	E.wrap_cap = st->wrap_cap; E.wrap_width = st->wrap_width; E.wrap_gap = st->wrap_gap;
+	E.fold = st->fold; E.brk = st->brk;
+	E.follow = st->follow; E.follow_wd = st->follow_wd; E.follow_dwd = st->follow_dwd; E.follow_partial = st->follow_partial;
+}
+
+int editorAddBuffer(const char *path) //register a buffer, nothing is read yet. returns its number
+{
+	if (E.nbufs == E.bufcap)
+	{
+		E.bufcap = E.bufcap ? E.bufcap * 2 : 16;
+		E.bufs = realloc(E.bufs, sizeof(editorBuffer) * E.bufcap);
+	}
+	editorBuffer *b = &E.bufs[E.nbufs];
+	memset(b, 0, sizeof(*b));
+	b->path = path ? strdup(path) : NULL;
+	b->st.hl_from = INT_MAX;
+	b->st.match_row = -1;
+	b->st.brk.from = INT_MAX; //not built
+	return E.nbufs++;
+}
+
+void editorBufferSwap(int n) //park the current buffer and put n in E as it was left
+{
+	if (E.curbuf >= 0) editorBufferStash(&E.bufs[E.curbuf].st);
+	E.curbuf = n;
+	editorBufferRestore(&E.bufs[n].st); //a fresh one restores to empty
+}
+
+void editorSwitchBuffer(int n) //make buffer n the one in E, loading it on first visit
+{
+	if (n < 0 || n >= E.nbufs || (n == E.curbuf && E.bufs[n].loaded)) return; //an unloaded current one failed to open, try again
+	editorBufferSwap(n);
+	editorBuffer *b = &E.bufs[n];
+	int fresh = !b->loaded;
+	if (!b->loaded)
+	{
+		b->loaded = 1;
+		if (b->path && access(b->path, F_OK) == 0)
+		{
+			if (editorOpen(b->path)) return; //its message says why
+		}
+		else if (b->path && strcmp(b->path, "-")) //new file, save creates it
+		{
+			E.filename = strdup(b->path);
+			editorSelectSyntaxHighlight();
+		}
+	}
+	if (E.hl_from != INT_MAX) pthread_cond_signal(&E.hl_cond); //it went back to sleep while we were away
+	if (fresh && E.gzip) return; //editorOpen's inflate rate says more
+	editorSetStatusMessage("buffer %d/%d: %s", n + 1, E.nbufs, E.filename ? E.filename : "[No Name]");
+}
+
+void editorBuffersInit(char **paths, int n) //the buffer list from the command line, first one loaded
+{
+	for (int i = 0; i < n; i++) editorAddBuffer(paths[i]);
+	if (n == 0) //whatever is in E is the one unnamed buffer
+	{
+		editorAddBuffer(NULL);
+		E.bufs[0].loaded = 1;
+		E.curbuf = 0;
+	}
+	else editorSwitchBuffer(0);
+}
+
+const char *editorBufferName(int n){
+	editorBuffer *b = &E.bufs[n];
+	const char *name = !b->loaded ? b->path : n == E.curbuf ? E.filename : b->st.filename;
+	return name ? name : "[No Name]";
+}
+
+int editorBufferDirty(int n){
+	return n == E.curbuf ? E.dirty : E.bufs[n].st.dirty;
+}
+
+int editorAnyDirty() //unsaved changes in any buffer
+{
+	if (E.dirty) return 1;
+	for (int i = 0; i < E.nbufs; i++)
+		if (editorBufferDirty(i)) return 1;
+	return 0;
+}
+
+void editorBufferList() //as many as fit around the current one, * = modified, () = not loaded yet
+{
+	char msg[sizeof(E.statusmsg)];
+	int first = E.curbuf > 2 ? E.curbuf - 2 : 0, len = 0;
+	if (first > 0) len = snprintf(msg, sizeof(msg), "... ");
+	for (int i = first; i < E.nbufs && len < (int)sizeof(msg) - 1; i++)
+	{
+		const char *name = strrchr(editorBufferName(i), '/');
+		name = name ? name + 1 : editorBufferName(i);
+		len += snprintf(msg + len, sizeof(msg) - len, "%s%d:%s%s%s%s ", i == E.curbuf ? ">" : "", i + 1,
+			E.bufs[i].loaded ? "" : "(", name, E.bufs[i].loaded ? "" : ")", editorBufferDirty(i) ? "*" : "");
+	}
+	editorSetStatusMessage("%s", msg);
+}
+
+void editorBufferPrompt() //Ctrl-O
+{
+	char *q = editorPromptEx("Buffer: %s (number, name or new file, empty lists)", NULL, 1);
+	if (!q) return;
+	if (!*q)
+	{
+		free(q);
+		editorBufferList();
+		return;
+	}
+
+	int n = -1;
+	char *end;
+	long num = strtol(q, &end, 10);
+	if (*end == '\0' && num >= 1 && num <= E.nbufs) n = num - 1;
+	for (int i = 0; n < 0 && i < E.nbufs; i++) //exact name first
+		if (!strcmp(editorBufferName(i), q)) n = i;
+	for (int i = 0; n < 0 && i < E.nbufs; i++) //then the first that contains it
+		if (strstr(editorBufferName(i), q)) n = i;
+	if (n < 0) n = editorAddBuffer(q);
+	free(q);
+	editorSwitchBuffer(n);
+}
+
+void editorCacheStoreAll() //on quit, every loaded buffer that matches its file
+{
+	int cur = E.curbuf;
+	for (int i = 0; i < E.nbufs; i++)
+	{
+		if (!E.bufs[i].loaded) continue;
+		editorSwitchBuffer(i);
+		editorCacheStore();
+	}
+	editorSwitchBuffer(cur);
+	if (E.nbufs == 0) editorCacheStore();
+}
+
+#pragma endregion
+
+#pragma region /*** Panes ***/
+
+//the screen is cut into panes, each a viewport with its own cursor and scroll onto any buffer.
+//two panes on one buffer share its rows, spans and everything else, only the view is per pane.
+//the focused pane's view lives in E (cx, cy, rowoff, screenrows...) so editing and movement
+//don't know panes exist; the others are swapped in just long enough to be drawn.
+//Ctrl-W then s splits top/bottom, v side by side, w moves to the next pane, c closes, o keeps only this one
+
+void editorPaneSave(editorPane *p) //E's view -> p
+{
+	p->buf = E.curbuf;
+	p->cx = E.cx; p->cy = E.cy; p->rx = E.rx; p->farx = E.farx;
+	p->rowoff = E.rowoff; p->coloff = E.coloff; p->wrapoff = E.wrapoff;
+}
+
+void editorPaneLoad(editorPane *p) //p's view -> E, swapping its buffer in if another pane had a different one
+{
+	if (p->buf >= 0 && p->buf != E.curbuf) editorBufferSwap(p->buf);
+	E.cx = p->cx; E.cy = p->cy; E.rx = p->rx; E.farx = p->farx;
+	E.rowoff = p->rowoff; E.coloff = p->coloff; E.wrapoff = p->wrapoff;
+	E.screenrows = p->rows;
+	E.screencols = p->cols;
+	if (E.hex) editorHexClamp(); //lines are offsets, the file may have been remapped
+	else if (E.cy > E.numrows) E.cy = E.numrows; //another pane deleted rows from under us
+	if (E.cy < E.numrows && E.cx > E.row[E.cy].size) E.cx = E.row[E.cy].size;
+}
+
+void editorPanesReady() //one pane over the whole screen to start with, cell grids to match the terminal
+{
+	if (E.npanes == 0)
+	{
+		E.panecap = 4;
+		E.panes = malloc(sizeof(editorPane) * E.panecap);
+		memset(&E.panes[0], 0, sizeof(editorPane));
+		E.panes[0].rows = E.termrows - 2; //status and message bars
+		E.panes[0].cols = E.termcols;
+		E.npanes = 1;
+		E.curpane = 0;
+		editorPaneSave(&E.panes[0]);
+	}
+	int n = E.termrows * E.termcols;
+	if (n != E.screencells)
+	{
+		E.screen = memRealloc(MEM_SCREEN, E.screen, sizeof(cell) * E.screencells, sizeof(cell) * n);
+		E.shown = memRealloc(MEM_SCREEN, E.shown, sizeof(cell) * E.screencells, sizeof(cell) * n);
+		E.screencells = n;
+		E.shown_valid = 0;
+	}
+}
+
+void editorPaneSplit(int vertical) //cut the focused pane in two, the new half shows the same place
+{
+	editorPane *p = &E.panes[E.curpane];
+	if (vertical ? p->cols < 3 : p->rows < 3)
+	{
+		editorSetStatusMessage("pane too small to split");
+		return;
+	}
+	if (E.npanes == E.panecap)
+	{
+		E.panecap *= 2;
+		E.panes = realloc(E.panes, sizeof(editorPane) * E.panecap);
+		p = &E.panes[E.curpane];
+	}
+	editorPaneSave(p);
+	editorPane *q = &E.panes[E.npanes++];
+	*q = *p;
+	if (vertical) //left keeps half, one column of separator, right gets the rest
+	{
+		p->cols = (q->cols - 1) / 2;
+		q->left = p->left + p->cols + 1;
+		q->cols -= p->cols + 1;
+	} else //top keeps half of the rows incl its status line, bottom gets the rest
+	{
+		int h = p->rows + 1;
+		p->rows = h / 2 - 1;
+		q->top = p->top + h / 2;
+		q->rows = h - h / 2 - 1;
+	}
+	editorPaneLoad(p);
+}
+
+void editorPaneFocus(int n) //move the cursor to pane n
+{
+	if (n == E.curpane) return;
+	editorPaneSave(&E.panes[E.curpane]);
+	E.curpane = n;
+	editorPaneLoad(&E.panes[n]);
+}
+
+void editorPaneClose() //give the focused pane's space to the neighbour that has the whole shared edge
+{
+	if (E.npanes == 1)
+	{
+		editorSetStatusMessage("last pane");
+		return;
+	}
+	editorPane *p = &E.panes[E.curpane];
+	int n;
+	for (n = 0; n < E.npanes; n++)
+	{
+		editorPane *q = &E.panes[n];
+		if (q == p) continue;
+		if (q->left == p->left && q->cols == p->cols) //stacked
+		{
+			if (q->top == p->top + p->rows + 1) q->top = p->top;
+			else if (q->top + q->rows + 1 != p->top) continue;
+			q->rows += p->rows + 1;
+			break;
+		}
+		if (q->top == p->top && q->rows == p->rows) //side by side
+		{
+			if (q->left == p->left + p->cols + 1) q->left = p->left;
+			else if (q->left + q->cols + 1 != p->left) continue;
+			q->cols += p->cols + 1;
+			break;
+		}
+	}
+	if (n == E.npanes)
+	{
+		editorSetStatusMessage("no pane can take this one's space");
+		return;
+	}
+	memmove(p, p + 1, sizeof(editorPane) * (E.npanes - E.curpane - 1));
+	E.npanes--;
+	E.curpane = n > E.curpane ? n - 1 : n;
+	editorPaneLoad(&E.panes[E.curpane]);
+}
+
+void editorPaneOnly() //the focused pane takes the whole screen
+{
+	editorPane *p = &E.panes[E.curpane];
+	editorPaneSave(p);
+	E.panes[0] = *p;
+	E.panes[0].top = E.panes[0].left = 0;
+	E.panes[0].rows = E.termrows - 2;
+	E.panes[0].cols = E.termcols;
+	E.npanes = 1;
+	E.curpane = 0;
+	editorPaneLoad(&E.panes[0]);
+}
+
+void editorPaneCommand() //Ctrl-W prefix
+{
+	editorSetStatusMessage("Ctrl-W: s split, v vsplit, w next, c close, o only");
+	editorRefreshScreen();
+	int c = editorReadKey();
+	editorSetStatusMessage("");
+	switch (c)
+	{
+		case 's': editorPaneSplit(0); break;
+		case 'v': editorPaneSplit(1); break;
+		case 'w':
+		case CTRL_KEY('w'): editorPaneFocus((E.curpane + 1) % E.npanes); break;
+		case 'c':
+		case 'q': editorPaneClose(); break;
+		case 'o': editorPaneOnly(); break;
+	}
+}
+
+#pragma endregion
+
+#pragma region /*** Follow ***/
+
+//Ctrl-T follows the buffer's file like tail -F: inotify wakes us when it's written to, only the bytes
+//past what was last read come in, and they're added as rows at the end without touching undo or dirty.
+//the new rows go to the highlight worker like a load. while the cursor is on the last line it stays
+//there so the end is in view. a file that shrinks (truncated) or is replaced by a new one
+//(rotated) is read again from the top, unless the buffer has edits of its own.
+//inotify is only read from the idle loop, so a busy log costs nothing while keys are coming in
+
+int editorFollowWatched(int wd) //some followed buffer still uses watch wd
+{
+	if (E.follow && (E.follow_wd == wd || E.follow_dwd == wd)) return 1;
+	for (int i = 0; i < E.nbufs; i++)
+	{
+		struct editorBufferState *st = &E.bufs[i].st;
+		if (i != E.curbuf && st->follow && (st->follow_wd == wd || st->follow_dwd == wd)) return 1;
+	}
+	return 0;
+}
+
+void editorFollowUnwatch(int wd){
+	if (!editorFollowWatched(wd)) inotify_rm_watch(E.inotify_fd, wd);
+}
+
+void editorFollowStop(){
+	E.follow = 0;
+	editorFollowUnwatch(E.follow_wd);
+	editorFollowUnwatch(E.follow_dwd);
+}
+
+void editorFollowAppend(const char *s, int len) //split appended bytes into rows, the first piece continues an unfinished last row
+{
+	const char *end = s + len;
+	while (s < end)
+	{
+		const char *nl = memchr(s, '\n', end - s);
+		int n = (nl ? nl : end) - s;
+		if (nl) while (n > 0 && s[n - 1] == '\r') n--; //same trimming as editorOpen
+		if (E.follow_partial && E.numrows)
+		{
+			erow *row = &E.row[E.numrows - 1];
+			if (n) editorRowAppendString(row, (char *)s, n);
+			if (nl && row->size > 0 && row->chars[row->size - 1] == '\r') editorRowDelChars(row, row->size - 1, 1); //\r and \n came in different reads
+		}
+		else editorInsertRow(E.numrows, (char *)s, n);
+		E.follow_partial = !nl;
+		s = nl ? nl + 1 : end;
+	}
+}
+
+int editorFollowEndsLine() //the file's last byte read so far is a newline (or there's none)
+{
+	char c = '\n';
+	int fd = open(E.filename, O_RDONLY);
+	if (fd == -1) return 1;
+	if (E.disk_size > 0 && pread(fd, &c, 1, E.disk_size - 1) != 1) c = '\n';
+	close(fd);
+	return c == '\n';
+}
+
+int editorFollowRead() //bring E's followed buffer up to what its file has now, 1 if anything changed
+{
+	int fd = open(E.filename, O_RDONLY);
+	if (fd == -1) return 0; //moved away, the new one shows up as a create in the directory
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+	{
+		close(fd);
+		return 0;
+	}
+
+	int pin = E.cy >= E.numrows - 1, changed = 0;
+	int rotated = st.st_dev != E.disk_dev || st.st_ino != E.disk_ino;
+	if (rotated || st.st_size < E.disk_size) //start over from the top
+	{
+		close(fd);
+		if (E.dirty)
+		{
+			editorFollowStop();
+			editorSetStatusMessage("%s was %s, stopped following (buffer has changes)", E.filename, rotated ? "replaced" : "truncated");
+			return 1;
+		}
+		if (rotated)
+		{
+			int old = E.follow_wd;
+			E.follow_wd = inotify_add_watch(E.inotify_fd, E.filename, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+			if (old != E.follow_wd) editorFollowUnwatch(old);
+		}
+		char *path = strdup(E.filename);
+		editorFreeRows();
+		int err = editorOpen(path);
+		free(path);
+		if (err)
+		{
+			editorFollowStop();
+			return 1;
+		}
+		E.follow_partial = E.numrows > 0 && !editorFollowEndsLine();
+		editorSetStatusMessage("%s was %s, read it again", E.filename, rotated ? "rotated" : "truncated");
+		changed = 1;
+	}
+	else if (st.st_size > E.disk_size)
+	{
+		int dirty = E.dirty, first = E.numrows - E.follow_partial;
+		E.undo_suspended++; //not an edit
+		E.hl_defer++; //the worker colors the new rows
+		char *buf = malloc(1 << 16);
+		ssize_t n;
+		while (E.disk_size < st.st_size && (n = pread(fd, buf, (st.st_size - E.disk_size < (1 << 16)) ? st.st_size - E.disk_size : (1 << 16), E.disk_size)) > 0)
+		{
+			editorFollowAppend(buf, n);
+			E.disk_size += n;
+		}
+		free(buf);
+		E.hl_defer--;
+		E.undo_suspended--;
+		E.dirty = dirty;
+		E.disk_mtime = st.st_mtim;
+		close(fd);
+		if (!dirty) editorDiskHashRows(first); //rows are the file, the new ones hash straight in
+		else
+		{
+			memFree(MEM_DISKHASH, E.disk_hash, sizeof(uint64_t) * E.disk_lines);
+			E.disk_hash = NULL; //no telling which rows are the file's any more
+			E.disk_lines = 0;
+		}
+		changed = 1;
+	}
+	else close(fd);
+
+	if (changed && pin)
+	{
+		E.cy = E.numrows ? E.numrows - 1 : 0;
+		E.cx = 0;
+	}
+	return changed;
+}
+
+void editorFollowToggle() //Ctrl-T
+{
+	if (E.follow)
+	{
+		editorFollowStop();
+		editorSetStatusMessage("stopped following %s", E.filename);
+		return;
+	}
+	if (!E.filename || E.disk_ino == 0)
+	{
+		editorSetStatusMessage("follow needs a buffer read from a file");
+		return;
+	}
+	if (E.gzip || E.hex)
+	{
+		editorSetStatusMessage("can't follow a %s", E.gzip ? "gzip file" : "file in hex view");
+		return;
+	}
+	if (E.inotify_fd == -1 && (E.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+	{
+		editorSetStatusMessage("inotify: %s", strerror(errno));
+		return;
+	}
+
+	char *dir = strdup(E.filename), *slash = strrchr(dir, '/');
+	if (!slash) strcpy(dir, ".");
+	else slash[slash == dir] = '\0'; //"/log" watches "/"
+	E.follow_wd = inotify_add_watch(E.inotify_fd, E.filename, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+	E.follow_dwd = inotify_add_watch(E.inotify_fd, dir, IN_CREATE | IN_MOVED_TO); //a rotated file's replacement
+	free(dir);
+	if (E.follow_wd == -1 || E.follow_dwd == -1)
+	{
+		editorSetStatusMessage("can't watch %s: %s", E.filename, strerror(errno));
+		if (E.follow_wd != -1) editorFollowUnwatch(E.follow_wd);
+		if (E.follow_dwd != -1) editorFollowUnwatch(E.follow_dwd);
+		return;
+	}
+
+	E.follow = 1;
+	E.follow_partial = E.numrows > 0 && !editorFollowEndsLine();
+	editorFollowRead(); //whatever was written since it was read
+	E.cy = E.numrows ? E.numrows - 1 : 0;
+	E.cx = 0;
+	editorSetStatusMessage("following %s, Ctrl-T stops", E.filename);
+}
+
+int editorFollowPoll() //idle hook: drain inotify and catch up every followed buffer, 1 if any changed
+{
+	if (E.inotify_fd == -1) return 0;
+	long buf[1024]; //aligned for struct inotify_event
+	int events = 0;
+	while (read(E.inotify_fd, buf, sizeof(buf)) > 0) events = 1;
+	if (!events) return 0;
+
+	//with a handful of followed files it's cheaper to look at each than to map watches to buffers
+	int cur = E.curbuf, changed = 0;
+	if (E.follow) changed |= editorFollowRead();
+	for (int i = 0; i < E.nbufs; i++)
+	{
+		if (i == cur || !E.bufs[i].st.follow) continue;
+		editorBufferSwap(i);
+		changed |= editorFollowRead();
+	}
+	if (E.curbuf != cur) editorBufferSwap(cur);
+	return changed;
+}
+
+#pragma endregion
+
+#pragma region /*** Stdin ***/
+
+//kilo - reads a pipe: `make 2>&1 | kilo -`. the terminal is opened again from /dev/tty and put on
+//fd 0 so keys and window size work as usual, the pipe keeps a descriptor of its own.
+//a reader thread copies from the pipe into a fixed ring and never touches E; the idle loop moves
+//what's there into rows, split the same way follow mode does it, so an unfinished last line is
+//just a row that keeps growing and the only buffering is the ring. a full ring stops the reader,
+//which stops the writer, nothing piles up. a wake pipe readable while the ring has bytes sits in
+//the idle poll next to the terminal, so rows show as they come instead of on the next tick.
+//the rows aren't an edit and aren't a file: no undo, not dirty, and Ctrl-S asks for a name
+
+void *editorStreamReader(void *arg) //pipe to ring until the pipe ends
+{
+	struct editorStream *s = arg;
+	pthread_mutex_lock(&s->lock);
+	while (!s->eof)
+	{
+		while (s->tail - s->head == s->cap) pthread_cond_wait(&s->room, &s->lock);
+		size_t at = s->tail % s->cap, room = s->cap - (s->tail - s->head);
+		if (room > s->cap - at) room = s->cap - at; //up to the wrap
+		pthread_mutex_unlock(&s->lock);
+		ssize_t n = read(s->fd, s->ring + at, room); //free space, nobody else looks at it till tail passes it
+		int err = errno;
+		pthread_mutex_lock(&s->lock);
+		if (n == -1 && err == EINTR) continue;
+		int wake = s->tail == s->head;
+		if (n > 0) s->tail += n;
+		else
+		{
+			s->eof = 1;
+			s->err = n ? err : 0;
+			wake = 1;
+		}
+		if (wake && write(s->wake[1], "w", 1) == -1) {} //full means it's readable already
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+void editorStreamTty() //before raw mode: keep the pipe, put the terminal where stdin was
+{
+	if (isatty(STDIN_FILENO))
+	{
+		fprintf(stderr, "kilo -: stdin is a terminal, pipe something in\n");
+		exit(1);
+	}
+	E.stream.fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+	int tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+	if (E.stream.fd == -1 || tty == -1 || dup2(tty, STDIN_FILENO) == -1) die("/dev/tty");
+	close(tty);
+}
+
+void editorStreamStart(int n) //rows from the pipe go to buffer n from now on
+{
+	struct editorStream *s = &E.stream;
+	E.bufs[n].loaded = 1; //nothing for editorSwitchBuffer to read
+	s->buf = n;
+	s->cap = 1 << 20;
+	s->ring = memAlloc(MEM_STREAM, s->cap);
+	s->head = s->tail = 0;
+	s->eof = s->err = 0;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->room, NULL);
+	if (pipe2(s->wake, O_NONBLOCK | O_CLOEXEC) == -1) die("pipe");
+	if (pthread_create(&s->reader, NULL, editorStreamReader, s) != 0) die("pthread_create");
+}
+
+void editorStreamEnd() //the reader is done and everything it read is in rows
+{
+	struct editorStream *s = &E.stream;
+	pthread_join(s->reader, NULL);
+	close(s->fd);
+	close(s->wake[0]);
+	close(s->wake[1]);
+	memFree(MEM_STREAM, s->ring, s->cap);
+	s->ring = NULL;
+	s->fd = s->buf = -1;
+	E.follow_partial = 0;
+	if (s->err) editorSetStatusMessage("stdin: %s after %d lines", strerror(s->err), E.numrows);
+	else editorSetStatusMessage("stdin: %d lines, Ctrl-S saves them", E.numrows);
+}
+
+int editorStreamRead() //ring to rows for E's buffer, 1 if anything changed
+{
+	struct editorStream *s = &E.stream;
+	int pin = E.cy >= E.numrows - 1, changed = 0, dirty = E.dirty, eof;
+	long t0 = editorProfNow();
+	E.undo_suspended++; //not an edit
+	E.hl_defer++;
+	for (;;)
+	{
+		pthread_mutex_lock(&s->lock);
+		size_t at = s->head % s->cap, n = s->tail - s->head;
+		if (n > s->cap - at) n = s->cap - at;
+		eof = s->eof;
+		if (n == 0) //drained under the lock, so a byte the reader adds after this is never eaten
+		{
+			char junk[64];
+			while (read(s->wake[0], junk, sizeof(junk)) > 0);
+		}
+		pthread_mutex_unlock(&s->lock);
+		if (n == 0) break;
+
+		editorFollowAppend(s->ring + at, n);
+		changed = 1;
+		pthread_mutex_lock(&s->lock);
+		s->head += n;
+		pthread_cond_signal(&s->room);
+		pthread_mutex_unlock(&s->lock);
+		if (editorProfNow() - t0 > 20000000) break; //paint, answer keys, the wake pipe brings us back
+	}
+	E.hl_defer--;
+	E.undo_suspended--;
+	E.dirty = changed && E.filename ? dirty + 1 : dirty; //saved part way, the file doesn't have these yet
+	if (eof && s->head == s->tail)
+	{
+		editorStreamEnd();
+		changed = 1;
+	}
+
+	if (changed && pin)
+	{
+		E.cy = E.numrows ? E.numrows - 1 : 0;
+		E.cx = 0;
+	}
+	return changed;
+}
+
+int editorStreamPoll() //idle hook: catch the stdin buffer up with the reader, 1 if it changed
+{
+	struct editorStream *s = &E.stream;
+	if (s->buf < 0) return 0;
+	pthread_mutex_lock(&s->lock);
+	int idle = s->head == s->tail && !s->eof;
+	pthread_mutex_unlock(&s->lock);
+	if (idle) return 0;
+
+	int cur = E.curbuf;
+	if (cur != s->buf) editorBufferSwap(s->buf);
+	int changed = editorStreamRead();
+	if (E.curbuf != cur) editorBufferSwap(cur);
+	return changed;
+}
+
+#pragma endregion
+
+#pragma region /*** Reload ***/
+
+//when the current buffer's file changes under us (checked while idle, by size, inode and mtime) it's
+//brought up to date without reading it into a fresh buffer. every buffer keeps a 64 bit hash per line
+//of its file as last read or written. the new file is split and hashed, diffed against the rows, and
+//only the rows in changed hunks are replaced, inserted or deleted, as one undo group, so Ctrl-Z takes
+//the reload back and everything before it is still there. cursor and scroll move with the rows.
+//a buffer with edits of its own asks first: merge does a three way merge by line against the old
+//hashes (hunks only one side touched go through, overlaps get <<<<<<< / >>>>>>> markers), reload
+//drops the edits, keep leaves the buffer alone and takes the new file as the base
+
+typedef struct diskHunk //lines a[a, a+alen) became b[b, b+blen)
+{
+	int a, alen, b, blen;
+} diskHunk;
+
+typedef struct diskSplice //one change to the rows, in row numbers from before any were made
+{
+	int at, del; //rows replaced
+	int from, n; //new file lines that replace them
+	int conflict; //keep the rows and put the new lines after them between markers
+} diskSplice;
+
+#define DISK_WINDOW 64 //how far ahead the diff looks for lines in common again
+
+uint64_t editorRowHash(erow *row){
+	return editorHash((const unsigned char *)row->chars, row->size);
+}
+
+void editorDiskHashRows(int from) //rows from on are the file's lines now, the ones before already hashed
+{
+	if (from > E.disk_lines) from = E.disk_lines;
+	E.disk_hash = memRealloc(MEM_DISKHASH, E.disk_hash, sizeof(uint64_t) * E.disk_lines, sizeof(uint64_t) * E.numrows);
+	E.disk_lines = E.numrows;
+	for (int i = from; i < E.numrows; i++) E.disk_hash[i] = editorRowHash(&E.row[i]);
+}
+
+int editorDiskChanged() //the current buffer's file was written by someone else since we last read or wrote it
+{
+	if (!E.filename || !E.disk_ino || E.follow || E.grep_view) return 0;
+	if (E.gzjob.active && E.gzjob.buf == E.curbuf) return 0; //our own save, still being written
+	struct stat st;
+	if (stat(E.filename, &st) == -1) return 0; //gone, saving puts it back
+	return st.st_size != E.disk_size || st.st_ino != E.disk_ino || st.st_dev != E.disk_dev ||
+		st.st_mtim.tv_sec != E.disk_mtime.tv_sec || st.st_mtim.tv_nsec != E.disk_mtime.tv_nsec;
+}
+
+diskHunk *editorDiff(const uint64_t *a, int na, const uint64_t *b, int nb, int *nhunks) //line diff on hashes
+{
+	diskHunk *h = NULL;
+	int n = 0, cap = 0;
+	int p = 0, s = 0;
+	while (p < na && p < nb && a[p] == b[p]) p++; //common ends first, usually that's nearly everything
+	while (s < na - p && s < nb - p && a[na - 1 - s] == b[nb - 1 - s]) s++;
+
+	//the middle greedily: at a mismatch find the nearest pair of lines that agree again (and the
+	//line after them too, so a blank line or a lone } doesn't count), within DISK_WINDOW
+	int i = p, j = p, ie = na - s, je = nb - s;
+	while (i < ie || j < je)
+	{
+		if (i < ie && j < je && a[i] == b[j])
+		{
+			i++;
+			j++;
+			continue;
+		}
+		int di = -1, dj = -1;
+		for (int d = 1; d <= 2 * DISK_WINDOW && di < 0; d++)
+			for (int x = d < DISK_WINDOW ? 0 : d - DISK_WINDOW; x <= d && x <= DISK_WINDOW; x++)
+			{
+				int y = d - x;
+				if (i + x >= ie || j + y >= je || a[i + x] != b[j + y]) continue;
+				if (i + x + 1 < ie && j + y + 1 < je && a[i + x + 1] != b[j + y + 1]) continue;
+				di = x;
+				dj = y;
+				break;
+			}
+		if (di < 0) //nothing in reach, call a window's worth changed and look again from there
+		{
+			di = ie - i < DISK_WINDOW ? ie - i : DISK_WINDOW;
+			dj = je - j < DISK_WINDOW ? je - j : DISK_WINDOW;
+		}
+		if (n && h[n - 1].a + h[n - 1].alen == i && h[n - 1].b + h[n - 1].blen == j) //runs on from the last one
+		{
+			h[n - 1].alen += di;
+			h[n - 1].blen += dj;
+		} else
+		{
+			if (n == cap)
+			{
+				cap = cap ? cap * 2 : 16;
+				h = realloc(h, sizeof(diskHunk) * cap);
+			}
+			h[n++] = (diskHunk){i, di, j, dj};
+		}
+		i += di;
+		j += dj;
+	}
+	*nhunks = n;
+	return h;
+}
+
+int editorDiskMerge(diskHunk *mine, int nmine, diskHunk *theirs, int ntheirs, const uint64_t *rows, const uint64_t *lines, diskSplice **out)
+{
+	//both lists are against the base. walk them together; hunks that touch (or just abut) are
+	//one group, which is a conflict if both sides are in it. returns the splices, in row order
+	diskSplice *sp = NULL;
+	int n = 0, cap = 0, i = 0, j = 0;
+	int mdelta = 0, tdelta = 0; //row number - base line, new file line - base line, past what's done
+	while (i < nmine || j < ntheirs)
+	{
+		int lo = (j == ntheirs || (i < nmine && mine[i].a < theirs[j].a)) ? mine[i].a : theirs[j].a, hi = lo;
+		int mnet = 0, tnet = 0, has_mine = 0, has_theirs = 0;
+		for (;;)
+		{
+			if (i < nmine && mine[i].a <= hi)
+			{
+				if (mine[i].a + mine[i].alen > hi) hi = mine[i].a + mine[i].alen;
+				mnet += mine[i].blen - mine[i].alen;
+				has_mine = 1;
+				i++;
+			} else if (j < ntheirs && theirs[j].a <= hi)
+			{
+				if (theirs[j].a + theirs[j].alen > hi) hi = theirs[j].a + theirs[j].alen;
+				tnet += theirs[j].blen - theirs[j].alen;
+				has_theirs = 1;
+				j++;
+			} else break;
+		}
+
+		diskSplice d = {lo + mdelta, hi - lo + mnet, lo + tdelta, hi - lo + tnet, has_mine};
+		int same = d.del == d.n; //both sides made the same change, nothing to do
+		for (int k = 0; same && k < d.n; k++) same = rows[d.at + k] == lines[d.from + k];
+		if (has_theirs && !same)
+		{
+			if (n == cap)
+			{
+				cap = cap ? cap * 2 : 16;
+				sp = realloc(sp, sizeof(diskSplice) * cap);
+			}
+			sp[n++] = d;
+		}
+		mdelta += mnet;
+		tdelta += tnet;
+	}
+	*out = sp;
+	return n;
+}
+
+void editorDiskMoveView(int at, int del, int n) //rows [at, at+del) became n rows, keep cursor and scroll on the same text
+{
+	int keep = del < n ? del : n;
+	if (E.cy >= at + del) E.cy += n - del;
+	else if (E.cy >= at + keep) E.cy = at + keep;
+	if (at < E.rowoff && E.rowoff >= at + del) E.rowoff += n - del; //changes from the top row down stay in view
+	else if (at < E.rowoff && E.rowoff >= at + keep) E.rowoff = at + keep;
+}
+
+void editorDiskSplice(diskSplice *d, const char **line, const int *len) //apply one splice, undoably
+{
+	if (d->conflict) //rows stay, the file's version goes in after them between markers
+	{
+		const char *m1 = "<<<<<<< buffer", *m2 = "=======", *m3 = ">>>>>>> disk";
+		int at = d->at + d->del;
+		editorInsertRow(at, (char *)m3, strlen(m3));
+		for (int k = d->n - 1; k >= 0; k--) editorInsertRow(at, (char *)line[d->from + k], len[d->from + k]);
+		editorInsertRow(at, (char *)m2, strlen(m2));
+		editorDiskMoveView(at, 0, d->n + 2);
+		editorInsertRow(d->at, (char *)m1, strlen(m1));
+		editorDiskMoveView(d->at, 0, 1);
+		return;
+	}
+
+	int keep = d->del < d->n ? d->del : d->n;
+	for (int k = 0; k < keep; k++) //same number of lines, swap the text in place
+	{
+		erow *row = &E.row[d->at + k];
+		int cap;
+		char *old = editorRowTakeChars(row, &cap);
+		editorUndoPush(UNDO_SET_ROW, d->at + k, 0, 0, old, row->size, cap);
+		editorRowSetChars(row, line[d->from + k], len[d->from + k]);
+		editorUpdateRow(row);
+	}
+	editorDelRows(d->at + keep, d->del - keep);
+	editorInsertRows(d->at + keep, (char **)&line[d->from + keep], &len[d->from + keep], d->n - keep);
+	editorDiskMoveView(d->at, d->del, d->n);
+}
+
+void editorDiskReload() //DISK_CHANGED
+{
+	if (E.hex)
+	{
+		editorHexReload();
+		return;
+	}
+	int fd = open(E.filename, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+	{
+		if (fd != -1) close(fd);
+		return;
+	}
+	char *map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (map == MAP_FAILED) return;
+	char *text = map, *plain = NULL; //what gets split, inflated for a .gz
+	size_t size = st.st_size;
+	int gzip = map && editorGzipMagic(map, size);
+	if (gzip)
+	{
+		plain = editorGzipText(map, st.st_size, &size);
+		munmap(map, st.st_size);
+		map = NULL;
+		if (!plain)
+		{
+			editorSetStatusMessage("%s changed on disk and is damaged, not reloaded", E.filename);
+			return;
+		}
+		text = plain;
+	}
+
+	//the new file's lines, split and trimmed like editorSplitRows, with their hashes
+	int nlines = 0, linecap = 0;
+	const char **line = NULL;
+	int *len = NULL;
+	uint64_t *hash = NULL;
+	for (const char *p = text, *end = text + size; p < end;)
+	{
+		const char *nl = memchr(p, '\n', end - p);
+		const char *eol = nl ? nl : end;
+		while (eol > p && eol[-1] == '\r') eol--;
+		if (nlines == linecap)
+		{
+			linecap = linecap ? linecap * 2 : 1024;
+			line = realloc(line, sizeof(char *) * linecap);
+			len = realloc(len, sizeof(int) * linecap);
+			hash = realloc(hash, sizeof(uint64_t) * linecap);
+		}
+		line[nlines] = p;
+		len[nlines] = eol - p;
+		hash[nlines++] = editorHash((const unsigned char *)p, eol - p);
+		p = nl ? nl + 1 : end;
+	}
+
+	int choice = 'r';
+	if (E.dirty)
+	{
+		const char *name = strrchr(E.filename, '/') ? strrchr(E.filename, '/') + 1 : E.filename;
+		do {
+			editorSetStatusMessage("%.24s changed on disk: %sr reload (drops your edits), k keep yours", name, E.disk_hash ? "m merge, " : "");
+			editorRefreshScreen();
+			choice = editorReadKey();
+			if (choice == '\x1b') choice = 'k';
+		} while (choice != 'r' && choice != 'k' && (choice != 'm' || !E.disk_hash));
+	}
+
+	int nsplice = 0, conflicts = 0;
+	if (choice != 'k')
+	{
+		uint64_t *rows = malloc(sizeof(uint64_t) * (E.numrows + 1));
+		for (int i = 0; i < E.numrows; i++) rows[i] = editorRowHash(&E.row[i]);
+		diskHunk *mine = NULL, *theirs;
+		int nmine = 0, ntheirs;
+		if (choice == 'm') //both against the base
+		{
+			mine = editorDiff(E.disk_hash, E.disk_lines, rows, E.numrows, &nmine);
+			theirs = editorDiff(E.disk_hash, E.disk_lines, hash, nlines, &ntheirs);
+		} else theirs = editorDiff(rows, E.numrows, hash, nlines, &ntheirs); //the rows are the base, nothing of ours to keep
+
+		diskSplice *sp;
+		nsplice = editorDiskMerge(mine, nmine, theirs, ntheirs, rows, hash, &sp);
+		int dirty = E.dirty;
+		E.hl_defer++; //changed rows go to the worker
+		for (int k = nsplice - 1; k >= 0; k--) //bottom up, so row numbers above stay put
+		{
+			editorDiskSplice(&sp[k], line, len);
+			conflicts += sp[k].conflict;
+		}
+		E.hl_defer--;
+		E.dirty = (choice == 'm' && (nmine || conflicts)) ? dirty + conflicts : 0;
+		if (E.cy > E.numrows) E.cy = E.numrows;
+		if (E.cy < E.numrows && E.cx > E.row[E.cy].size) E.cx = E.row[E.cy].size;
+		if (E.rowoff > E.cy) E.rowoff = E.cy;
+		free(rows);
+		free(mine);
+		free(theirs);
+		free(sp);
+	}
+
+	//the new file is the base from here on, whatever was chosen
+	memFree(MEM_DISKHASH, E.disk_hash, sizeof(uint64_t) * E.disk_lines);
+	E.disk_hash = memAlloc(MEM_DISKHASH, sizeof(uint64_t) * nlines);
+	memcpy(E.disk_hash, hash, sizeof(uint64_t) * nlines);
+	E.disk_lines = nlines;
+	E.disk_size = st.st_size;
+	E.disk_dev = st.st_dev;
+	E.disk_ino = st.st_ino;
+	E.disk_mtime = st.st_mtim;
+	E.cache_hit = 0;
+	E.gzip = gzip;
+
+	if (choice == 'k') editorSetStatusMessage("kept your edits, the file on disk differs");
+	else if (conflicts) editorSetStatusMessage("merged with the file, %d conflict%s (<<<<<<<)", conflicts, conflicts == 1 ? "" : "s");
+	else editorSetStatusMessage("%s from disk, %d change%s", choice == 'm' ? "merged" : "reloaded", nsplice, nsplice == 1 ? "" : "s");
+	if (map) munmap(map, st.st_size);
+	free(plain);
+	free(line);
+	free(len);
+	free(hash);
+}
+
+#pragma endregion
+
+#pragma region //Find
+const char *editorFindInText(const char *text, size_t len, const char *query, size_t qlen) //first occurrence of query in text, NULL if none
+{
+	if (qlen == 0 || qlen > len) return NULL;
+	return memmem(text, len, query, qlen);
+}
+
+void editorFindCallback(char *query, int key) {
+	static int last_match = -1; //last match maintain throuhgout calls
+	static int direction = 1; //search dir  maintain throuhgout calls
+	
+	E.match_row = -1; //drop the last match's overlay
+
+
+	//set's our direction and curr match
+	if (key == '\r' || key == '\x1b') //exits search if escape/enter pressed
+	{
+		last_match = -1;
+		direction = 1;
+		return;
+	} else if (key == ARROW_RIGHT || key == ARROW_DOWN) //next match
+	{
+		direction = 1; 
+	} else if (key == ARROW_LEFT || key == ARROW_UP) //prev match
+	{
+		direction = -1; 
+	} else //maintain match
+	{
+		last_match = -1; 
+		direction = 1;
+	}
+
+	if (last_match == -1) direction = 1; //reset direction to 1
+	int current = last_match; //set current match
+	int i; //loop counter
+	for (i = 0; i < E.numrows; i++) //iterate through rows
+	{
+		current += direction; //go to next match
+		if (current == -1) current = E.numrows -1; //if last match go to first match
+		else if (current == E.numrows) current = 0; //if first match go to last match
+
+		erowdraw *row = &E.rowdraw[current]; //temp row for internal use
+		const char *match = editorFindInText(row->render, row->rsize, query, strlen(query)); //check row for matches and return string
+		if (match) //match found
+		{
+			last_match = current; //set last_match to curr
+			E.cy = current; //update cursor position to point to match
+			E.cx = editorRowRiToCx(&E.row[current], match - row->render); //convert render pos to cx and move mouse to match
+			E.rowoff = E.numrows; //position match at top of editor
+			
+			E.match_row = current; //color the match blue, over the row's own colors
+			E.match_at = match - row->render;
+			E.match_len = strlen(query);
+			break;
+		}
+
+	}
+
+}
+
+void editorFind(){
+	int saved_cx = E.cx;
+	int saved_cy = E.cy;
+	int saved_coloff = E.coloff;
+	int saved_rowoff = E.rowoff;
+
+	char *query = editorPrompt("Search: %s (Use ESC/Arrows/Enter)", editorFindCallback);
+	if (query){
+		free(query);
+	} else {
+		E.cx = saved_cx;
+		E.cy = saved_cy;
+		E.coloff = saved_coloff;
+		E.rowoff = saved_rowoff;
+	}
+}
+
+#pragma endregion
+
+#pragma region //Undo/Replace
+
+void editorUndo() //reverse every op of the most recent group
+{
+	if (E.undolen == 0)
+	{
+		editorSetStatusMessage("Nothing to undo");
+		return;
+	}
+	int group = E.undo[E.undolen - 1].group;
+	int first = E.numrows, last = -1; //range of swapped rows, highlighted once at the end
+
+	E.undo_suspended++;
+	while (E.undolen > 0 && E.undo[E.undolen - 1].group == group)
+	{
+		editorUndoOp *op = &E.undo[--E.undolen];
+		erow *row = (op->row < E.numrows) ? &E.row[op->row] : NULL;
+		switch (op->type)
+		{
+			case UNDO_INSERT_CHAR:
+				editorRowDelChars(row, op->col, op->len);
+				break;
+			case UNDO_DELETE_CHAR:
+				if (op->text) editorRowInsertChars(row, op->col, op->text, op->len);
+				else editorRowInsertChar(row, op->col, op->c);
+				break;
+			case UNDO_INSERT_ROW: //a run of rows inserted one under the other (a paste, a reload) goes in one shift
+			{
+				int n = 1;
+				while (E.undolen > 0 && E.undo[E.undolen - 1].group == group && E.undo[E.undolen - 1].type == UNDO_INSERT_ROW && E.undo[E.undolen - 1].row == op->row - 1)
+				{
+					op = &E.undo[--E.undolen];
+					n++;
+				}
+				editorDelRows(op->row, n);
+				break;
+			}
+			case UNDO_DELETE_ROW: //rows deleted at the same place come back in one shift too
+			{
+				int n = 1;
+				while (E.undolen > n - 1 && E.undo[E.undolen - n].group == group && E.undo[E.undolen - n].type == UNDO_DELETE_ROW && E.undo[E.undolen - n].row == op->row) n++;
+				if (n == 1)
+				{
+					editorInsertRow(op->row, op->text, op->len);
+					break;
+				}
+				//op and the n - 1 under it, last deleted first, so the lowest one in the log is the first row
+				char **text = malloc(sizeof(char *) * n);
+				int *len = malloc(sizeof(int) * n);
+				editorUndoOp *run = &E.undo[E.undolen - n + 1];
+				for (int k = 0; k < n; k++)
+				{
+					text[k] = run[k].text;
+					len[k] = run[k].len;
+				}
+				editorInsertRows(op->row, text, len, n);
+				for (int k = 1; k < n; k++) arenaFree(&E.arena, run[k].text, run[k].cap);
+				op = run;
+				E.undolen -= n - 1;
+				free(text);
+				free(len);
+				break;
+			}
+			case UNDO_APPEND_STRING: //chop the appended tail back off
+				row->size = op->col;
+				row->chars[row->size] = '\0';
+				editorUpdateRowFrom(row, op->col);
+				E.dirty++;
+				break;
+			case UNDO_TRUNCATE_ROW:
+				editorRowAppendString(row, op->text, op->len);
+				break;
+			case UNDO_SET_ROW: //swap the old text back in, render now but highlight later
+				editorRowSetChars(row, op->text, op->len);
+				editorRenderRow(row);
+				if (op->row < first) first = op->row;
+				if (op->row > last) last = op->row;
+				E.dirty++;
+				break;
+		}
+		E.cy = op->row;
+		E.cx = op->col;
+		arenaFree(&E.arena, op->text, op->cap);
+	}
+	E.undo_suspended--;
+
+	if (last >= 0) editorUpdateSyntaxRange(first, last);
+	if (E.cy > E.numrows) E.cy = E.numrows;
+	int rowlen = (E.cy < E.numrows) ? E.row[E.cy].size : 0;
+	if (E.cx > rowlen) E.cx = rowlen;
+	editorSetFarx();
+}
+
+struct rbuf //growable scratch buffer for building replaced rows
+{
+	char *b;
+	int len;
+	int cap;
+};
+
+void rbAppend(struct rbuf *rb, const char *s, int len){
+	if (rb->len + len > rb->cap)
+	{
+		int old = rb->cap;
+		while (rb->len + len > rb->cap) rb->cap = rb->cap ? rb->cap * 2 : 256;
+		rb->b = memRealloc(MEM_SEARCH, rb->b, old, rb->cap);
+	}
+	memcpy(&rb->b[rb->len], s, len);
+	rb->len += len;
+}
+
+int editorReplaceLiteral(erow *row, const char *query, int qlen, const char *with, int wlen, struct rbuf *out) //write replaced row into out, return num of matches
+{
+	const char *p = row->chars;
+	const char *end = row->chars + row->size;
+	const char *m;
+	int n = 0;
+	while ((m = memmem(p, end - p, query, qlen)) != NULL)
+	{
+		rbAppend(out, p, m - p); //text before match
+		rbAppend(out, with, wlen);
+		p = m + qlen;
+		n++;
+	}
+	if (n) rbAppend(out, p, end - p); //rest of line
+	return n;
+}
+
+int editorReplaceRegex(erow *row, regex_t *re, const char *with, struct rbuf *out) //same as literal but with \0-\9 backrefs
+{
+	regmatch_t pm[10];
+	int off = 0;
+	int eflags = 0;
+	int n = 0;
+	int last = -1; //where the last non-empty match ended
+	while (off <= row->size && regexec(re, &row->chars[off], 10, pm, eflags) == 0)
+	{
+		int so = off + pm[0].rm_so;
+		int eo = off + pm[0].rm_eo;
+		rbAppend(out, &row->chars[off], so - off);
+		if (eo == so && so == last) //empty match right where the last one ended, sed and vim leave it
+		{
+			if (so < row->size) rbAppend(out, &row->chars[so], 1);
+			off = so + 1;
+			eflags = REG_NOTBOL;
+			continue;
+		}
+		for (const char *w = with; *w; w++) //expand replacement
+		{
+			if (w[0] == '\\' && isdigit((unsigned char)w[1]))
+			{
+				int g = w[1] - '0';
+				if (pm[g].rm_so != -1) rbAppend(out, &row->chars[off + pm[g].rm_so], pm[g].rm_eo - pm[g].rm_so);
+				w++;
+			} else if (w[0] == '\\' && w[1] == '\\')
+			{
+				rbAppend(out, "\\", 1);
+				w++;
+			} else {
+				rbAppend(out, w, 1);
+			}
+		}
+		n++;
+		if (eo == so) //empty match, step over one char so we don't loop forever
+		{
+			if (so < row->size) rbAppend(out, &row->chars[so], 1);
+			off = so + 1;
+		} else {
+			off = last = eo;
+		}
+		eflags = REG_NOTBOL;
+	}
+	if (n && off < row->size) rbAppend(out, &row->chars[off], row->size - off);
+	return n;
+}
+
+void editorReplace(int use_regex) //replace all matches, every row rebuilt once and highlighted once
+{
+	char *query = editorPrompt(use_regex ? "Replace regex: %s (ESC to cancel)" : "Replace: %s (ESC to cancel)", NULL);
+	if (query == NULL) return;
+	char *with = editorPromptEx("Replace with: %s (ESC to cancel)", NULL, 1);
+	if (with == NULL)
+	{
+		free(query);
+		return;
+	}
+
+	regex_t re;
+	if (use_regex)
+	{
+		int err = regcomp(&re, query, REG_EXTENDED);
+		if (err)
+		{
+			char msg[64];
+			regerror(err, &re, msg, sizeof(msg));
+			editorSetStatusMessage("Bad regex: %s", msg);
+			free(query);
+			free(with);
+			return;
+		}
+	}
+
+	int qlen = strlen(query);
+	int wlen = strlen(with);
+	struct rbuf out = {NULL, 0, 0};
+	int first = -1, last = -1;
+	long total = 0;
+	int rows = 0;
+
+	//pass 1: compute each row's new text and swap it in, old text goes to the undo log
+	for (int i = 0; i < E.numrows; i++)
+	{
+		erow *row = &E.row[i];
+		out.len = 0;
+		int n = use_regex ? editorReplaceRegex(row, &re, with, &out) : editorReplaceLiteral(row, query, qlen, with, wlen, &out);
+		if (n == 0) continue;
+
+		int cap;
+		char *old = editorRowTakeChars(row, &cap);
+		editorUndoPush(UNDO_SET_ROW, i, 0, 0, old, row->size, cap);
+		editorRowSetChars(row, out.b, out.len);
+		editorRenderRow(row);
+
+		if (first == -1) first = i;
+		last = i;
+		total += n;
+		rows++;
+	}
+
+	//pass 2: one highlight sweep from the first changed row
+	if (first != -1) editorUpdateSyntaxRange(first, last);
+
+	E.dirty += rows;
+	int rowlen = (E.cy < E.numrows) ? E.row[E.cy].size : 0;
+	if (E.cx > rowlen) E.cx = rowlen;
+	editorSetStatusMessage("Replaced %ld occurrences on %d lines", total, rows);
+
+	if (use_regex) regfree(&re);
+	memFree(MEM_SEARCH, out.b, out.cap);
+	free(query);
+	free(with);
+}
+
+#pragma endregion
+
+#pragma region //Grep Mode
+/* kilo --grep PATTERN DIR: walk DIR, mmap every file and search them on a
+   work stealing pool. Each worker owns a deque, pops its own jobs from the
+   back and steals from the front of the others when it runs dry. */
+
+#define GREP_MAX_TEXT 256 //longest line text kept per result
+
+struct grepDeque //one worker's job queue
+{
+	pthread_mutex_t lock;
+	char **paths;
+	int head, tail, cap; //jobs live in [head, tail)
+};
+
+struct grepPool
+{
+	struct grepDeque *q;
+	int nworkers;
+	volatile int walk_done; //walker finished pushing
+	const char *query;
+	size_t qlen;
+	long files;
+
+	pthread_mutex_t lock; //guards results
+	grepMatch *matches;
+	int nmatches, cap;
+};
+
+struct grepWorker
+{
+	struct grepPool *pool;
+	int id;
+};
+
+void grepDequePush(struct grepDeque *d, char *path){
+	pthread_mutex_lock(&d->lock);
+	if (d->head > 0 && d->head == d->tail) d->head = d->tail = 0; //empty, rewind
+	if (d->tail == d->cap)
+	{
+		d->cap = d->cap ? d->cap * 2 : 64;
+		d->paths = realloc(d->paths, sizeof(char *) * d->cap);
+	}
+	d->paths[d->tail++] = path;
+	pthread_mutex_unlock(&d->lock);
+}
+
+char *grepDequePop(struct grepDeque *d, int steal) //owner pops newest, thieves take oldest
+{
+	char *path = NULL;
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail) path = steal ? d->paths[d->head++] : d->paths[--d->tail];
+	pthread_mutex_unlock(&d->lock);
+	return path;
+}
+
+void grepAddMatch(struct grepPool *p, const char *path, int line, int col, const char *text, int len){
+	if (len > GREP_MAX_TEXT) len = GREP_MAX_TEXT;
+	pthread_mutex_lock(&p->lock);
+	if (p->nmatches == p->cap)
+	{
+		int old = p->cap;
+		p->cap = p->cap ? p->cap * 2 : 256;
+		p->matches = memRealloc(MEM_GREP, p->matches, sizeof(grepMatch) * old, sizeof(grepMatch) * p->cap); //p->lock keeps grep threads off each other's counts
+	}
+	grepMatch *m = &p->matches[p->nmatches++];
+	m->path = strdup(path);
+	m->line = line;
+	m->col = col;
+	m->text = strndup(text, len);
+	m->len = strlen(m->text);
+	memCount(MEM_GREP, strlen(m->path) + 1 + m->len + 1);
+	pthread_mutex_unlock(&p->lock);
+}
+
+void grepSearchFile(struct grepPool *p, const char *path) //mmap file and report every line containing the query
+{
+	int fd = open(path, O_RDONLY | O_NONBLOCK); //a fifo swapped in since the walk doesn't hang the worker
+	if (fd == -1) return;
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		close(fd);
+		return;
+	}
+	size_t size = st.st_size;
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return;
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	if (memchr(data, '\0', size < 8192 ? size : 8192) == NULL) //skip binaries like grep -I
+	{
+		const char *end = data + size;
+		const char *counted = data; //newlines counted up to here
+		int line = 0;
+		const char *at = data;
+		const char *m;
+		while ((m = editorFindInText(at, end - at, p->query, p->qlen)) != NULL)
+		{
+			const char *c;
+			while ((c = memchr(counted, '\n', m - counted)) != NULL) //count lines up to the match
+			{
+				line++;
+				counted = c + 1;
+			}
+			const char *eol = memchr(m, '\n', end - m);
+			if (eol == NULL) eol = end;
+			int len = eol - counted;
+			if (len > 0 && counted[len - 1] == '\r') len--;
+			grepAddMatch(p, path, line, m - counted, counted, len);
+			at = eol; //one result per line
+			if (at == end) break;
+		}
+	}
+	munmap(data, size);
+}
+
+void *grepWorkerMain(void *arg){
+	struct grepWorker *w = arg;
+	struct grepPool *p = w->pool;
+	while (1)
+	{
+		char *path = grepDequePop(&p->q[w->id], 0);
+		for (int i = 1; !path && i < p->nworkers; i++) path = grepDequePop(&p->q[(w->id + i) % p->nworkers], 1); //steal
+		if (path)
+		{
+			grepSearchFile(p, path);
+			free(path);
+			continue;
+		}
+		if (p->walk_done)
+		{
+			int left = 0; //walker may have pushed between our pops and the flag
+			for (int i = 0; i < p->nworkers; i++)
+			{
+				pthread_mutex_lock(&p->q[i].lock);
+				left += p->q[i].tail - p->q[i].head;
+				pthread_mutex_unlock(&p->q[i].lock);
+			}
+			if (!left) break;
+		} else {
+			struct timespec ts = {0, 50000}; //walker still busy, nap 50us
+			nanosleep(&ts, NULL);
+		}
+	}
+	return NULL;
+}
+
+void grepWalk(struct grepPool *p, const char *dir) //push every regular file under dir, round robin over the deques
+{
+	DIR *d = opendir(dir);
+	if (!d) return;
+	struct dirent *ent;
+	while ((ent = readdir(d)) != NULL)
+	{
+		if (ent->d_name[0] == '.') continue; //skips . .. and hidden files (.git etc.)
+		size_t plen = strlen(dir) + strlen(ent->d_name) + 2;
+		char *path = malloc(plen);
+		snprintf(path, plen, "%s/%s", dir, ent->d_name);
+
+		int type = ent->d_type;
+		if (type == DT_UNKNOWN || type == DT_LNK) //links to files are searched, links to dirs aren't followed like grep -r: one back up the tree would walk it forever
+		{
+			struct stat st;
+			if (type == DT_UNKNOWN && lstat(path, &st) == 0 && S_ISLNK(st.st_mode)) type = DT_LNK;
+			int ok = stat(path, &st) == 0;
+			if (ok && S_ISREG(st.st_mode)) type = DT_REG;
+			else if (ok && S_ISDIR(st.st_mode) && type != DT_LNK) type = DT_DIR;
+			else type = DT_UNKNOWN; //fifos, devices and sockets aren't files to search, open would block on a fifo
+		}
+		if (type == DT_DIR)
+		{
+			grepWalk(p, path);
+			free(path);
+		} else if (type == DT_REG) {
+			grepDequePush(&p->q[p->files++ % p->nworkers], path);
+		} else {
+			free(path);
+		}
+	}
+	closedir(d);
+}
+
+int grepMatchCmp(const void *a, const void *b){
+	const grepMatch *x = a, *y = b;
+	int c = strcmp(x->path, y->path);
+	return c ? c : x->line - y->line;
+}
+
+void editorGrepShow() //fill the buffer with the result list
+{
+	editorFreeRows();
+	free(E.filename);
+	E.filename = strdup("[grep results]");
+	E.syntax = NULL;
+	E.undo_suspended++;
+	for (int i = 0; i < E.grepnum; i++)
+	{
+		grepMatch *m = &E.grep[i];
+		int len = snprintf(NULL, 0, "%s:%d: ", m->path, m->line + 1);
+		char *line = malloc(len + m->len + 1);
+		snprintf(line, len + 1, "%s:%d: ", m->path, m->line + 1);
+		memcpy(&line[len], m->text, m->len);
+		editorInsertRow(E.numrows, line, len + m->len);
+		free(line);
+
+		erowdraw *d = &E.rowdraw[i];
+		int ri = editorRowCxToRi(&E.row[i], len + m->col);
+		int qlen = strlen(E.grep_query);
+		if (ri + qlen <= d->rsize) editorHlPaint(&E.arena, d, ri, qlen, HL_MATCH); //show where it hit, no syntax so it's the only run
+	}
+	E.undo_suspended--;
+	E.dirty = 0;
+	E.grep_view = 1;
+	E.cy = E.grep_sel < E.numrows ? E.grep_sel : 0;
+}
+
+void editorGrep(char *query, char *dir) //run the search and show results
+{
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	struct grepPool p;
+	memset(&p, 0, sizeof(p));
+	p.query = query;
+	p.qlen = strlen(query);
+	p.nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (p.nworkers < 1) p.nworkers = 1;
+	pthread_mutex_init(&p.lock, NULL);
+	p.q = calloc(p.nworkers, sizeof(struct grepDeque));
+	struct grepWorker *w = malloc(sizeof(struct grepWorker) * p.nworkers);
+	pthread_t *tid = malloc(sizeof(pthread_t) * p.nworkers);
+	for (int i = 0; i < p.nworkers; i++)
+	{
+		pthread_mutex_init(&p.q[i].lock, NULL);
+		w[i].pool = &p;
+		w[i].id = i;
+		pthread_create(&tid[i], NULL, grepWorkerMain, &w[i]);
+	}
+
+	grepWalk(&p, dir);
+	__sync_synchronize();
+	p.walk_done = 1;
+	for (int i = 0; i < p.nworkers; i++) pthread_join(tid[i], NULL);
+
+	for (int i = 0; i < p.nworkers; i++)
+	{
+		free(p.q[i].paths);
+		pthread_mutex_destroy(&p.q[i].lock);
+	}
+	pthread_mutex_destroy(&p.lock);
+	free(p.q);
+	free(w);
+	free(tid);
+
+	qsort(p.matches, p.nmatches, sizeof(grepMatch), grepMatchCmp); //workers finish in any order
+	E.grep = p.matches;
+	E.grepnum = p.nmatches;
+	E.grep_query = strdup(query);
+	E.grep_sel = 0;
+	editorGrepShow();
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+	editorSetStatusMessage("%d matches, %ld files searched in %ldms | Enter = open, Ctrl-G = back to results", E.grepnum, p.files, ms);
+}
+
+void editorGrepOpen() //open the result under the cursor through the normal editorOpen path
+{
+	if (E.cy >= E.grepnum) return;
+	grepMatch *m = &E.grep[E.cy];
+	E.grep_sel = E.cy;
+	E.grep_view = 0;
+	editorFreeRows();
+	if (editorOpen(m->path)) return; //Ctrl-G still goes back to the list
+	E.cy = m->line < E.numrows ? m->line : E.numrows;
+	E.cx = (E.cy < E.numrows && m->col <= E.row[E.cy].size) ? m->col : 0;
+	editorSetFarx();
+	E.rowoff = E.cy > E.screenrows / 2 ? E.cy - E.screenrows / 2 : 0; //land mid screen
+}
+
+void editorGrepBack() //Ctrl-G, go back to the list
+{
+	if (E.grep == NULL) return;
+	if (E.dirty)
+	{
+		editorSetStatusMessage("Unsaved changes, save first (Ctrl-S)");
+		return;
+	}
+	editorGrepShow();
+}
+
+int editorGrepProcessKey(int c) //results list is read only, returns 1 if c was handled
+{
+	switch (c)
+	{
+		case '\r':
+			editorGrepOpen();
+			return 1;
+		case ARROW_UP:
+		case ARROW_DOWN:
+		case PAGE_UP:
+		case PAGE_DOWN:
+		case HOME_KEY:
+		case END_KEY:
+		case ARROW_LEFT:
+		case ARROW_RIGHT:
+		case CTRL_KEY('q'):
+		case CTRL_KEY('f'):
+		case CTRL_KEY('n'):
+		case CTRL_KEY('b'):
+		case CTRL_KEY('o'):
+		case CTRL_KEY('w'):
+		case DISK_CHANGED:
+			return 0; //let the normal handler move/quit/search/switch buffers/panes
+		default:
+			return 1; //swallow edits
+	}
+}
+
+#pragma endregion
+
+#pragma region /*** input ***/
+void editorSetFarx() //remember the cursor's screen column for up/down
+{
+	E.farx = 0;
+	if (E.cy < E.numrows) editorRowWalk(&E.row[E.cy], offsetof(erowcp, cx), E.cx, &E.farx, NULL);
+}
+
+char *editorPrompt(char *prompt, void(*callback)(char *, int)){
+	return editorPromptEx(prompt, callback, 0);
+}
+
+char *editorPromptEx(char *prompt, void(*callback)(char *, int), int allow_empty){
+	size_t bufsize = 128;
+	char *buf = memRealloc(MEM_SEARCH, NULL, 0, bufsize);
+
+	size_t buflen = 0;
+	buf[0] = '\0';
+
+	while (1) {
+		editorSetStatusMessage(prompt, buf);
+		editorRefreshScreen();
+
+		int c = editorReadKey();
+		if (c == DELETE_KEY || c == CTRL_KEY('h') || c == BACKSPACE){
+			if (buflen != 0) buf [--buflen] = '\0';
+		} else if (c == '\x1b') {
+			editorSetStatusMessage("");
+			if (callback) callback(buf, c);
+			memFree(MEM_SEARCH, buf, bufsize);
+			return NULL;
+		} else if (c == '\r'){
+			if(buflen != 0 || allow_empty){
+				editorSetStatusMessage("");
+				if (callback) callback(buf, c);
+				memCount(MEM_SEARCH, -(long)bufsize); //the caller's now, freed with plain free
+				return buf;
+			}
+		} else if (!iscntrl(c) && c < 256){ //ascii and utf-8 bytes
+			if(buflen == bufsize -1){
+				buf = memRealloc(MEM_SEARCH, buf, bufsize, bufsize * 2);
+				bufsize *= 2;
+			}
+			buf[buflen++] = c;
+			buf[buflen] = '\0';
+		}
+		if (callback) callback(buf, c);
+	}
+}
+
+void editorMoveCursor(int key){
+	erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+	if (E.wrap && (key == ARROW_UP || key == ARROW_DOWN || key == PAGE_UP || key == PAGE_DOWN))
+	{
+		editorWrapMove(key);
+		return;
+	}
+
+	switch (key) {
+		case ARROW_UP:
+			if(E.cy > 0) E.cy = editorFoldPrev(E.cy);
+			break;
+
+		case ARROW_DOWN:
+			if(E.cy < E.numrows) E.cy = editorFoldNext(E.cy);
+			break;
+
+		case ARROW_LEFT:
+			if(E.cx > 0){
+				E.cx = editorRowPrevCluster(row, E.cx); //whole char, not one byte
+			} else if (E.cy > 0){
+				E.cy = editorFoldPrev(E.cy);
+				E.cx = E.row[E.cy].size;
+			}
+			editorSetFarx();
+			break;
+		
+		case ARROW_RIGHT:
+			if(row && E.cx < row->size){
+				E.cx = editorRowNextCluster(row, E.cx);
+				
+			} else if (E.cy < E.numrows){
+				E.cy = editorFoldNext(E.cy);
+				E.cx = 0;
+			}
+			editorSetFarx();
+			break;
+
+		case PAGE_UP:
+		case PAGE_DOWN: //top or bottom of the pane, then a pane further. closed folds take one line
+			if (key == PAGE_UP){
+				E.cy = E.rowoff;
+			} else {
+				E.cy = editorFoldRow(editorFoldLine(E.rowoff) + E.screenrows - 1);
+			}
+			for (int times = E.screenrows; times--; ) editorMoveCursor(key == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+			break;
+	}
+	if (key == ARROW_UP || key == ARROW_DOWN) //land on the same screen column, never inside a char
+	{
+		row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+		E.cx = row ? editorRowRXtoCX(row, E.farx) : 0;
+	}
+
+}
+
+void editorProcessKeypress(){
+	//maintain count across calls
+	static int quit_times = KILO_QUIT_TIMES;
+
+	//get c from editor
+	E.key_top = 1;
+	int c = E.key_held ? E.key_held : editorReadKey();
+	E.key_top = 0;
+	E.key_held = 0;
+	E.undo_group++; //everything this key does undoes as one unit
+	if (E.grep_view && editorGrepProcessKey(c)) return;
+	if (E.hex && editorHexProcessKey(c)) return;
+	
+	//if c is a hotkey, apply case behavior
+	switch (c) {
+		case '\r':
+			editorInsertNewline();
+			break;
+
+		case CTRL_KEY('s'):
+			editorSave();
+			break;
+
+		case CTRL_KEY('q'):
+			if (E.curclient >= 0) //the buffers stay resident for the next attach
+			{
+				editorClientDetach();
+				return;
+			}
+			editorGzipWait(); //a save in flight lands first, one that fails leaves its buffer dirty
+			if (editorAnyDirty() && quit_times > 0) {
+				editorSetStatusMessage("WARNING!!! File has unsaved changes." "Press Ctrl-Q %d more times to quit", quit_times);
+				quit_times--;
+				return;
+			}
+			clearScreen();
+			editorCacheStoreAll(); //only buffers still the same as what's on disk
+			exit(0);
+			break;
+
+		case HOME_KEY:
+			E.cx = 0;
+			editorSetFarx();
+			break;
+		case END_KEY:
+			E.cx = (E.cy < E.numrows) ? E.row[E.cy].size : E.cx;
+			editorSetFarx();
+			break;
+			
+		case CTRL_KEY('f'):
+			editorFind();
+			break;
+
+		case CTRL_KEY('r'):
+			editorReplace(0);
+			break;
+
+		case CTRL_KEY('e'):
+			editorReplace(1);
+			break;
+
+		case CTRL_KEY('z'):
+			editorUndo();
+			break;
+
+		case CTRL_KEY('g'):
+			editorGrepBack();
+			break;
+
+		case CTRL_KEY('a'):
+			editorMemReport();
+			break;
+
+		case CTRL_KEY('p'):
+			editorProfToggle();
+			break;
+
+		case CTRL_KEY('n'):
+			if (E.nbufs) editorSwitchBuffer((E.curbuf + 1) % E.nbufs);
+			break;
+
+		case CTRL_KEY('b'):
+			if (E.nbufs) editorSwitchBuffer((E.curbuf + E.nbufs - 1) % E.nbufs);
+			break;
+
+		case CTRL_KEY('o'):
+			editorBufferPrompt();
+			break;
+
+		case CTRL_KEY('t'):
+			editorFollowToggle();
+			break;
+
+		case CTRL_KEY('x'):
+			editorHexToggle();
+			break;
+
+		case CTRL_KEY('v'):
+			editorWrapToggle();
+			break;
+
+		case CTRL_KEY('k'):
+			editorFoldToggle();
+			break;
+
+		case CTRL_KEY('u'):
+			editorFoldAll();
+			break;
+
+		case CTRL_KEY(']'):
+			editorBracketJump();
+			break;
+
+		case DISK_CHANGED:
+			editorDiskReload();
+			break;
+
+		case BACKSPACE:
+		case CTRL_KEY('h'):
+			editorBackspace();
+			editorSetFarx();
+			break;
+		case DELETE_KEY:
+			editorDelChar();
+			break;
+			
+			
+		
+		case PAGE_UP:
+		case PAGE_DOWN:
+		case ARROW_UP:
+		case ARROW_DOWN:
+		case ARROW_LEFT:
+		case ARROW_RIGHT:
+			editorMoveCursor(c);	
+			break;
+
+		case CTRL_KEY('w'):
+			editorPaneCommand();
+			break;
+
+		case CTRL_KEY('l'): //redraw everything
+			E.shown_valid = 0;
+			break;
+
+		case '\x1b':
+			break;
+		
+		default:
+			if (c >= 0xC0 && c < 0xF8) //utf-8 lead byte, pull in the rest so the char goes in whole
+			{
+				char buf[4];
+				int n = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : 2;
+				buf[0] = c;
+				int i;
+				for (i = 1; i < n; i++)
+				{
+					int k = editorReadKey();
+					if ((k & ~0x3F) != 0x80) //not a 10xxxxxx tail, the char is dropped and k is a key of its own
+					{
+						E.key_held = k;
+						break;
+					}
+					buf[i] = k;
+				}
+				if (i == n) editorInsertChars(buf, n);
+			} else {
+				editorInsertChar(c);
+			}
+			editorSetFarx();
+			break;
+	}
+
+	quit_times = KILO_QUIT_TIMES;
+}
+#pragma endregion
+
+/*** Initialization ***/
+void initEditor(){
+	//init editor to def state
+	E.cx = 0;
+	E.cy = 0;
+	E.rx = 0;
+
+	//offset init
+	E.numrows = 0;
+	E.rowoff = 0;
+	E.coloff = 0;
+	E.row = NULL;
+	E.rowdraw = NULL;
+
+	//file status
 	E.dirty = 0;
-	editorSetStatusMessage("%d bytes written to disk", len); //closing message
-	return;
+
+	//undo log
+	E.undo = NULL;
+	E.undolen = 0;
+	E.undocap = 0;
+	E.undo_group = 0;
+	E.undo_suspended = 0;
+
+	//background highlighting
+	pthread_mutex_init(&E.lock, NULL);
+	pthread_cond_init(&E.hl_cond, NULL);
+	E.hl_from = INT_MAX;
+	E.hl_nstale = 0;
+	E.hl_defer = 0;
+	E.hl_repaint = 0;
+	E.hlver = 0;
+
+	//highlight cache
+	E.cache_hit = 0;
+
+	//find overlay
+	E.match_row = -1;
+
+	//file on disk, follow mode
+	E.disk_size = 0;
+	E.disk_dev = 0;
+	E.disk_ino = 0;
+	E.disk_mtime.tv_sec = E.disk_mtime.tv_nsec = 0;
+	E.disk_hash = NULL;
+	E.disk_lines = 0;
+	E.key_top = 0;
+	E.key_held = 0;
+	E.follow = E.follow_wd = E.follow_dwd = E.follow_partial = 0;
+	E.inotify_fd = -1;
+
+	//soft wrap, off until Ctrl-V
+	E.wrap = E.wrapoff = 0;
+	E.wrap_lines = E.wrap_tree = NULL;
+	E.wrap_cap = E.wrap_width = E.wrap_gap = 0;
+
+	//folds, none until Ctrl-K or Ctrl-U
+	memset(&E.fold, 0, sizeof(E.fold));
+
+	//bracket index, built on first use
+	memset(&E.brk, 0, sizeof(E.brk));
+	E.brk.from = INT_MAX; //not built
+	E.pair_row[0] = E.pair_row[1] = -1;
+
+	//status bar
+	E.filename = NULL;
+	E.statusmsg[0] = '\0';
+	E.statusmsg_time = 0;
+
+	//syntax settings
+	E.syntax = NULL;
+
+	//grep results
+	E.grep = NULL;
+	E.grepnum = 0;
+	E.grep_view = 0;
+	E.grep_sel = 0;
+	E.grep_query = NULL;
+
+	//terminal
+	E.outfd = STDOUT_FILENO;
+	E.record_fd = -1;
+	memset(&E.replay, 0, sizeof(E.replay));
+
+	//profiler, off until Ctrl-P or KILO_PROFILE
+	memset(&E.prof, 0, sizeof(E.prof));
+
+	//buffer list
+	E.bufs = NULL;
+	E.nbufs = E.bufcap = 0;
+	E.curbuf = -1;
+
+	//server, off unless kilo --server
+	E.clients = NULL;
+	E.nclients = E.clientcap = 0;
+	E.curclient = -1;
+	E.listenfd = -1;
+
+	//kilo -, off unless main starts it
+	memset(&E.stream, 0, sizeof(E.stream));
+	E.stream.fd = -1;
+	E.stream.buf = -1;
+
+	//memory accounting
+	memset(E.mem, 0, sizeof(E.mem));
+	E.mem_dump = NULL;
+
+	//screen, main asks the terminal for the real size
+	E.termrows = 24;
+	E.termcols = 80;
+	E.screenrows = E.termrows - 2;
+	E.screencols = E.termcols;
+	E.panes = NULL;
+	E.npanes = E.panecap = E.curpane = 0;
+	E.screen = E.shown = NULL;
+	E.screencells = 0;
+	E.shown_valid = 0;
+}
+
+#pragma region /*** Replay ***/
+
+//kilo --replay script.keys [--output FILE] [FILE...] runs a recorded key stream (kilo --record makes one,
+//it's just the raw bytes the terminal sent) through editorProcessKeypress as fast as it goes. frames
+//go to FILE (/dev/null by default) on an 80x24 screen. highlighting is flushed after every key instead
+//of left to the worker so runs repeat exactly. the report is a line of JSON on stdout at the end
+
+void editorReplayKeyStart(int c) //a byte was read, start the clock unless it's the tail of a utf-8 char
+{
+	struct editorReplay *r = &E.replay;
+	if (r->pending)
+	{
+		r->pending--;
+		return;
+	}
+	r->started = 1;
+	r->pending = (c >= 0xF0 && c < 0xF8) ? 3 : (c >= 0xE0 && c < 0xF0) ? 2 : (c >= 0xC0 && c < 0xE0) ? 1 : 0;
+	clock_gettime(CLOCK_MONOTONIC, &r->t0);
+}
+
+void editorReplayKeyEnd() //input is wanted again, the key being timed is done
+{
+	struct editorReplay *r = &E.replay;
+	if (!r->started || r->pending) return;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (r->nkeys == r->keycap)
+	{
+		r->keycap = r->keycap ? r->keycap * 2 : 1024;
+		r->ns = realloc(r->ns, sizeof(long) * r->keycap);
+	}
+	r->ns[r->nkeys++] = (t1.tv_sec - r->t0.tv_sec) * 1000000000L + (t1.tv_nsec - r->t0.tv_nsec);
+	r->started = 0;
+}
+
+void editorReplayFrame(int bytes) //a frame of this many bytes went out
+{
+	struct editorReplay *r = &E.replay;
+	if (r->nframes == r->framecap)
+	{
+		r->framecap = r->framecap ? r->framecap * 2 : 1024;
+		r->bytes = realloc(r->bytes, sizeof(int) * r->framecap);
+	}
+	r->bytes[r->nframes++] = bytes;
+}
+
+int editorCmpLong(const void *a, const void *b){
+	long x = *(const long *)a, y = *(const long *)b;
+	return (x > y) - (x < y);
+}
+
+int editorCmpInt(const void *a, const void *b){
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+void editorReplayReport() //atexit, percentiles of everything recorded
+{
+	struct editorReplay *r = &E.replay;
+	long total = 0, bytes = 0;
+	for (int i = 0; i < r->nkeys; i++) total += r->ns[i];
+	for (int i = 0; i < r->nframes; i++) bytes += r->bytes[i];
+	if (r->nkeys) qsort(r->ns, r->nkeys, sizeof(long), editorCmpLong);
+	if (r->nframes) qsort(r->bytes, r->nframes, sizeof(int), editorCmpInt);
+	#define PCT(v, n, p) ((n) ? (v)[(long)((n) - 1) * (p) / 100] : 0) //nearest rank on a sorted array
+	printf("{\"replay\":\"%s\",\"keys\":%d,\"frames\":%d,\"total_ms\":%.3f,\"key_mean_ns\":%ld,"
+		"\"key_p50_ns\":%ld,\"key_p99_ns\":%ld,\"key_max_ns\":%ld,\"frame_bytes_total\":%ld,"
+		"\"frame_bytes_p50\":%d,\"frame_bytes_p99\":%d,\"frame_bytes_max\":%d}\n",
+		r->path, r->nkeys, r->nframes, total / 1e6, r->nkeys ? total / r->nkeys : 0,
+		PCT(r->ns, r->nkeys, 50), PCT(r->ns, r->nkeys, 99), PCT(r->ns, r->nkeys, 100), bytes,
+		PCT(r->bytes, r->nframes, 50), PCT(r->bytes, r->nframes, 99), PCT(r->bytes, r->nframes, 100));
+	#undef PCT
+	fflush(stdout);
+}
+
+int editorReplayMain(int argc, char *argv[]) //kilo --replay script.keys [--output FILE] [FILE...]
+{
+	const char *output = "/dev/null";
+	char **files = malloc(sizeof(char *) * argc);
+	int nfiles = 0;
+	for (int i = 3; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--output") && i + 1 < argc) output = argv[++i];
+		else files[nfiles++] = argv[i];
+	}
+
+	initEditor(); //no raw mode, no worker, default screen
+	editorProfStart();
+	editorMemStart();
+	pthread_mutex_lock(&E.lock);
+
+	FILE *fp = fopen(argv[2], "rb");
+	struct stat st;
+	if (!fp || fstat(fileno(fp), &st) == -1) die("replay");
+	char *keys = malloc(st.st_size + 1);
+	E.replay.len = fread(keys, 1, st.st_size, fp);
+	E.replay.keys = keys;
+	fclose(fp);
+	E.replay.path = argv[2];
+
+	if ((E.outfd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) die("output");
+	editorBuffersInit(files, nfiles);
+	free(files);
+	editorHlFlush(); //loading isn't part of the run
+	atexit(editorReplayReport);
+
+	while (1) {
+		editorHlFlush();
+		editorRefreshScreen();
+		editorProcessKeypress();
+	}
+	return 0;
 }
 
 #pragma endregion
 
-#pragma region //Find
-void editorFindCallback(char *query, int key) {
-	static int last_match = -1; //last match maintain throuhgout calls
-	static int direction = 1; //search dir  maintain throuhgout calls
-	
-	static int saved_hl_line; //track higlighted match line
-	static char *saved_hl = NULL; //Store original line settings
+#pragma region /*** Server ***/
+
+//kilo --server [FILE...] keeps buffers loaded and highlighted between sessions. kilo --client [FILE]
+//is a thin terminal: it forwards keystrokes over a UNIX socket ($KILO_SOCKET, else /tmp/kilo-UID.sock)
+//and copies whatever comes back to the terminal. every client gets its own screen, panes and
+//message bar, swapped into E the way panes and buffers are, and the compositor sends each one
+//only the cells that changed on its terminal. opening a path that's already resident is a buffer switch.
+//client -> server messages are a type byte, a 16 bit little endian length and the payload:
+//'k' keystrokes, 'w' "ROWS COLS", 'o' absolute path to open. server -> client is terminal output.
+//a client in a prompt has the server to itself until it's answered, the others queue up
+
+static volatile sig_atomic_t editorServerQuit; //SIGINT/SIGTERM
+static volatile sig_atomic_t editorClientWinch; //SIGWINCH in the client
+
+void editorSocketAddr(struct sockaddr_un *sa) //KILO_SOCKET or a per user default
+{
+	const char *path = getenv("KILO_SOCKET");
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	if (path && *path) snprintf(sa->sun_path, sizeof(sa->sun_path), "%s", path);
+	else snprintf(sa->sun_path, sizeof(sa->sun_path), "/tmp/kilo-%d.sock", (int)getuid());
+}
 
-	if (saved_hl)  // a saved hl exists
+int editorSocketConnect(struct sockaddr_un *sa) //-1 if nobody is listening
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) return -1;
+	if (connect(fd, (struct sockaddr *)sa, sizeof(*sa)) == -1)
 	{
-		memcpy(E.row[saved_hl_line].hl, saved_hl, E.row[saved_hl_line].rsize); //copy original settings back into row
-		free(saved_hl); //free string so no trigger next time;
-		saved_hl = NULL; //reset to null.
+		close(fd);
+		return -1;
 	}
+	return fd;
+}
 
+char *editorAbsPath(const char *path) //so a server started elsewhere finds the same file, the file may not exist yet
+{
+	char *abs = realpath(path, NULL);
+	if (abs || path[0] == '/') return abs ? abs : strdup(path);
+	char cwd[PATH_MAX];
+	if (!getcwd(cwd, sizeof(cwd))) return strdup(path);
+	abs = malloc(strlen(cwd) + strlen(path) + 2);
+	sprintf(abs, "%s/%s", cwd, path);
+	return abs;
+}
 
-	//set's our direction and curr match
-	if (key == '\r' || key == '\x1b') //exits search if escape/enter pressed
+int editorClientSend(int fd, int type, const char *s, int len) //one message in one write, -1 if the server is gone
+{
+	char *msg = malloc(len + 3);
+	msg[0] = type;
+	msg[1] = len & 0xff;
+	msg[2] = (len >> 8) & 0xff;
+	memcpy(msg + 3, s, len);
+	int ok = write(fd, msg, len + 3) == len + 3;
+	free(msg);
+	return ok ? 0 : -1;
+}
+
+void editorClientStash(editorClient *c) //E's screen -> c, E is left with none
+{
+	if (E.npanes) editorPaneSave(&E.panes[E.curpane]);
+	c->termrows = E.termrows; c->termcols = E.termcols;
+	c->panes = E.panes; c->npanes = E.npanes; c->panecap = E.panecap; c->curpane = E.curpane;
+	c->screen = E.screen; c->shown = E.shown;
+	c->screencells = E.screencells; c->shown_valid = E.shown_valid;
+	memcpy(c->statusmsg, E.statusmsg, sizeof(E.statusmsg));
+	c->statusmsg_time = E.statusmsg_time;
+	E.panes = NULL;
+	E.npanes = E.panecap = E.curpane = 0;
+	E.screen = E.shown = NULL;
+	E.screencells = E.shown_valid = 0;
+	E.outfd = -1;
+}
+
+void editorClientRestore(editorClient *c) //c -> E, its focused pane's buffer and view with it
+{
+	E.termrows = c->termrows; E.termcols = c->termcols;
+	E.panes = c->panes; E.npanes = c->npanes; E.panecap = c->panecap; E.curpane = c->curpane;
+	E.screen = c->screen; E.shown = c->shown;
+	E.screencells = c->screencells; E.shown_valid = c->shown_valid;
+	memcpy(E.statusmsg, c->statusmsg, sizeof(E.statusmsg));
+	E.statusmsg_time = c->statusmsg_time;
+	E.outfd = c->fd;
+	if (E.npanes) editorPaneLoad(&E.panes[E.curpane]);
+}
+
+void editorClientSwap(int n) //make client n the one in E, -1 = none
+{
+	if (n == E.curclient) return;
+	if (E.curclient >= 0) editorClientStash(&E.clients[E.curclient]);
+	E.curclient = n;
+	if (n >= 0) editorClientRestore(&E.clients[n]);
+}
+
+void editorClientFeed(editorClient *c) //read what the socket has and sort out the messages
+{
+	if (c->rawcap - c->rawlen < 4096)
 	{
-		last_match = -1;
-		direction = 1;
+		c->rawcap = c->rawlen + 8192;
+		c->raw = realloc(c->raw, c->rawcap);
+	}
+	int n = read(c->fd, c->raw + c->rawlen, c->rawcap - c->rawlen);
+	if (n <= 0)
+	{
+		if (n == 0 || (errno != EINTR && errno != EAGAIN)) c->dead = 1;
 		return;
-	} else if (key == ARROW_RIGHT || key == ARROW_DOWN) //next match
+	}
+	c->rawlen += n;
+
+	int at = 0;
+	while (c->rawlen - at >= 3)
 	{
-		direction = 1; 
-	} else if (key == ARROW_LEFT || key == ARROW_UP) //prev match
+		unsigned char *m = (unsigned char *)c->raw + at;
+		int len = m[1] | m[2] << 8;
+		if (c->rawlen - at < 3 + len) break; //rest of it is still on the way
+		char *payload = c->raw + at + 3;
+		if (m[0] == 'k')
+		{
+			if (c->keypos == c->keylen) c->keypos = c->keylen = 0;
+			if (c->keylen + len > c->keycap)
+			{
+				c->keycap = (c->keylen + len) * 2;
+				c->keys = realloc(c->keys, c->keycap);
+			}
+			memcpy(c->keys + c->keylen, payload, len);
+			c->keylen += len;
+		} else if (m[0] == 'w' && len < 32)
+		{
+			char size[32];
+			int rows, cols;
+			memcpy(size, payload, len);
+			size[len] = '\0';
+			if (sscanf(size, "%d %d", &rows, &cols) == 2)
+			{
+				c->rows = rows < 3 ? 3 : rows; //text, status and message rows at least
+				c->cols = cols < 1 ? 1 : cols;
+			}
+		} else if (m[0] == 'o')
+		{
+			free(c->open);
+			c->open = malloc(len + 1);
+			memcpy(c->open, payload, len);
+			c->open[len] = '\0';
+		}
+		at += 3 + len;
+	}
+	memmove(c->raw, c->raw + at, c->rawlen - at);
+	c->rawlen -= at;
+}
+
+int editorClientReadByte(char *c) //editorReadByte for the current client, waits like the terminal's VTIME
+{
+	editorClient *cl = &E.clients[E.curclient];
+	struct pollfd pfd = {cl->fd, POLLIN, 0};
+	while (cl->keypos == cl->keylen && !cl->dead && poll(&pfd, 1, 100) > 0) editorClientFeed(cl); //a message can arrive in pieces
+	if (cl->dead) //gone, an endless run of Escape backs out of any prompt it was in
 	{
-		direction = -1; 
-	} else //maintain match
+		*c = '\x1b';
+		return 1;
+	}
+	if (cl->keypos == cl->keylen) return 0;
+	*c = cl->keys[cl->keypos++];
+	return 1;
+}
+
+void editorClientDetach() //Ctrl-Q from a client
+{
+	clearScreen();
+	E.clients[E.curclient].dead = 1;
+}
+
+void editorOpenResident(const char *path) //switch to path's buffer, adding one if nobody has opened it
+{
+	int n;
+	for (n = 0; n < E.nbufs; n++)
+		if (E.bufs[n].path && !strcmp(E.bufs[n].path, path)) break;
+	if (n == E.nbufs) n = editorAddBuffer(path);
+	if (n == E.curbuf && E.bufs[n].loaded) editorSetStatusMessage("buffer %d/%d: %s", n + 1, E.nbufs, E.filename ? E.filename : "[No Name]");
+	else editorSwitchBuffer(n);
+}
+
+void editorClientUpdate() //apply what the current client sent: size, file, keys
+{
+	editorClient *cl = &E.clients[E.curclient];
+	if (cl->rows != E.termrows || cl->cols != E.termcols) //first frame or a resize, panes start over
+	{
+		E.termrows = cl->rows;
+		E.termcols = cl->cols;
+		if (E.npanes) editorPaneOnly();
+	}
+	editorPanesReady();
+	if (cl->open)
+	{
+		editorOpenResident(cl->open);
+		free(cl->open);
+		cl->open = NULL;
+	}
+	while (!cl->dead && cl->keypos < cl->keylen)
+	{
+		editorScroll(); //page keys go by the scroll a frame would have set
+		editorProcessKeypress();
+	}
+}
+
+void editorClientAccept()
+{
+	int fd = accept(E.listenfd, NULL, NULL);
+	if (fd == -1) return;
+	if (E.nclients == E.clientcap)
+	{
+		E.clientcap = E.clientcap ? E.clientcap * 2 : 4;
+		E.clients = realloc(E.clients, sizeof(editorClient) * E.clientcap);
+	}
+	editorClient *c = &E.clients[E.nclients++];
+	memset(c, 0, sizeof(*c));
+	c->fd = fd;
+}
+
+void editorClientDrop(int n) //hung up, its screen goes but the buffers it had open stay
+{
+	editorClient *c = &E.clients[n];
+	free(c->panes);
+	memFree(MEM_SCREEN, c->screen, sizeof(cell) * c->screencells);
+	memFree(MEM_SCREEN, c->shown, sizeof(cell) * c->screencells);
+	free(c->raw);
+	free(c->keys);
+	free(c->open);
+	close(c->fd);
+	memmove(c, c + 1, sizeof(editorClient) * (E.nclients - n - 1));
+	E.nclients--;
+}
+
+void editorServerStop(int sig){
+	(void)sig;
+	editorServerQuit = 1;
+}
+
+int editorServerMain(int argc, char *argv[]) //kilo --server [FILE...]
+{
+	struct sockaddr_un sa;
+	editorSocketAddr(&sa);
+	int fd = editorSocketConnect(&sa);
+	if (fd != -1)
+	{
+		fprintf(stderr, "kilo: a server is already running on %s\n", sa.sun_path);
+		return 1;
+	}
+
+	initEditor(); //no terminal, each client brings its own
+	E.outfd = -1;
+	editorProfStart();
+	editorMemStart();
+	pthread_mutex_lock(&E.lock);
+
+	//everything named up front is read and highlighted before the first client shows up
+	int nfiles = argc - 2;
+	char **files = malloc(sizeof(char *) * (nfiles + 1));
+	for (int i = 0; i < nfiles; i++) files[i] = editorAbsPath(argv[i + 2]);
+	editorBuffersInit(files, nfiles);
+	for (int i = 0; i < nfiles; i++)
+	{
+		editorSwitchBuffer(i);
+		editorHlFlush();
+		free(files[i]);
+	}
+	free(files);
+	if (nfiles) editorSwitchBuffer(0);
+	pthread_mutex_unlock(&E.lock);
+
+	unlink(sa.sun_path); //left over from one that didn't get to clean up
+	mode_t mask = umask(077); //only this user gets to attach
+	E.listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (E.listenfd == -1 || bind(E.listenfd, (struct sockaddr *)&sa, sizeof(sa)) == -1 || listen(E.listenfd, 16) == -1) die("socket");
+	umask(mask);
+
+	struct sigaction act;
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = editorServerStop;
+	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGTERM, &act, NULL);
+	signal(SIGPIPE, SIG_IGN); //a client that hangs up mid frame is noticed on its next read
+	fprintf(stderr, "kilo: serving %d buffer%s on %s\n", E.nbufs, E.nbufs == 1 ? "" : "s", sa.sun_path);
+	editorHlStart();
+
+	struct pollfd *pfds = NULL;
+	int pfdcap = 0;
+	while (!editorServerQuit)
+	{
+		if (pfdcap < E.nclients + 1)
+		{
+			pfdcap = (E.nclients + 1) * 2;
+			pfds = realloc(pfds, sizeof(struct pollfd) * pfdcap);
+		}
+		int npfds = E.nclients + 1;
+		pfds[0] = (struct pollfd){E.listenfd, POLLIN, 0};
+		for (int i = 0; i < E.nclients; i++) pfds[i + 1] = (struct pollfd){E.clients[i].fd, POLLIN, 0};
+
+		pthread_mutex_unlock(&E.lock); //the highlight worker gets E while we wait
+		int ready = poll(pfds, npfds, 100);
+		pthread_mutex_lock(&E.lock);
+		if (ready == -1 && errno != EINTR) die("poll");
+
+		int repaint = editorFollowPoll();
+		repaint |= editorGzipSaved();
+		repaint |= E.hl_repaint;
+		E.hl_repaint = 0;
+		for (int i = 1; ready > 0 && i < npfds; i++)
+			if (pfds[i].revents) editorClientFeed(&E.clients[i - 1]);
+		if (ready > 0 && (pfds[0].revents & POLLIN)) editorClientAccept();
+
+		for (int i = 0; i < E.nclients; i++)
+		{
+			editorClient *c = &E.clients[i];
+			if (c->dead || !c->rows) continue; //no screen size, nothing to draw on yet
+			if (c->rows == c->termrows && c->cols == c->termcols && !c->open && c->keypos == c->keylen) continue;
+			editorClientSwap(i);
+			editorClientUpdate();
+			repaint = 1;
+		}
+
+		for (int i = 0; i < E.nclients; i++) //a file changed under a client's focused buffer, it gets asked
+		{
+			if (E.clients[i].dead || !E.clients[i].termrows) continue;
+			editorClientSwap(i);
+			if (!editorDiskChanged()) continue;
+			E.undo_group++;
+			editorDiskReload();
+			repaint = 1;
+		}
+
+		editorClientSwap(-1);
+		for (int i = E.nclients - 1; i >= 0; i--)
+			if (E.clients[i].dead) editorClientDrop(i);
+
+		//something changed, and buffers are shared, so everyone gets a frame. the ones it
+		//didn't touch get a cursor move
+		for (int i = 0; repaint && i < E.nclients; i++)
+		{
+			if (!E.clients[i].termrows) continue;
+			editorClientSwap(i);
+			editorRefreshScreen();
+		}
+	}
+
+	editorClientSwap(-1);
+	while (E.nclients) editorClientDrop(E.nclients - 1);
+	close(E.listenfd);
+	unlink(sa.sun_path);
+	if (editorAnyDirty()) fprintf(stderr, "kilo: stopped with unsaved changes\n");
+	editorCacheStoreAll();
+	exit(0);
+}
+
+void editorClientWinched(int sig){
+	(void)sig;
+	editorClientWinch = 1;
+}
+
+int editorClientMain(int argc, char *argv[]) //kilo --client [FILE]
+{
+	struct sockaddr_un sa;
+	editorSocketAddr(&sa);
+	int fd = editorSocketConnect(&sa);
+	if (fd == -1)
+	{
+		fprintf(stderr, "kilo: no server on %s (start one with kilo --server)\n", sa.sun_path);
+		return 1;
+	}
+
+	initEditor();
+	enableRawMode();
+	struct sigaction act;
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = editorClientWinched; //no SA_RESTART, poll has to wake up for it
+	sigaction(SIGWINCH, &act, NULL);
+	editorClientWinch = 1; //the server needs the size before anything else
+	if (argc >= 3)
+	{
+		char *path = editorAbsPath(argv[2]);
+		editorClientSend(fd, 'o', path, strlen(path));
+		free(path);
+	}
+
+	char buf[8192];
+	while (1)
+	{
+		if (editorClientWinch)
+		{
+			editorClientWinch = 0;
+			int rows, cols;
+			if (getWindowSize(&rows, &cols) == -1) die("getWindowSize");
+			int len = snprintf(buf, sizeof(buf), "%d %d", rows, cols);
+			if (editorClientSend(fd, 'w', buf, len) == -1) break;
+		}
+		struct pollfd pfds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+		if (poll(pfds, 2, -1) == -1)
+		{
+			if (errno == EINTR) continue;
+			die("poll");
+		}
+		if (pfds[0].revents & POLLIN)
+		{
+			int n = read(STDIN_FILENO, buf, 255);
+			if (n > 0 && editorClientSend(fd, 'k', buf, n) == -1) break;
+		}
+		if (pfds[1].revents)
+		{
+			int n = read(fd, buf, sizeof(buf));
+			if (n <= 0) break; //detached or the server went away
+			if (write(STDOUT_FILENO, buf, n) != n) die("write");
+		}
+	}
+	return 0;
+}
+
+#pragma endregion
+
+#pragma region /*** Benchmark ***/
+
+//make bench builds kilo-bench: the same editor core driven by synthetic workloads instead of a terminal.
+//malloc/calloc/realloc are wrapped at link time (-Wl,--wrap) so every allocation kilo.c makes is counted,
+//allocations made inside libc itself (getline, strdup, regcomp) are not. one JSON object per line on stdout
+
+#ifdef KILO_BENCH
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+long bench_allocs; //calls since the last benchStart
+size_t bench_alloc_bytes;
+
+void *__wrap_malloc(size_t size)
+{
+	bench_allocs++;
+	bench_alloc_bytes += size;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	bench_allocs++;
+	bench_alloc_bytes += n * size;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	bench_allocs++;
+	bench_alloc_bytes += size;
+	return __real_realloc(p, size);
+}
+
+struct benchRun
+{
+	const char *name;
+	struct timespec t0;
+	long arena_allocs;
+};
+
+void benchStart(struct benchRun *r, const char *name) //zero the counters and the rss high water mark
+{
+	int fd = open("/proc/self/clear_refs", O_WRONLY); //"5" resets VmHWM to the current rss
+	if (fd != -1)
+	{
+		if (write(fd, "5", 1) != 1) {}
+		close(fd);
+	}
+	r->name = name;
+	r->arena_allocs = E.arena.allocs;
+	bench_allocs = 0;
+	bench_alloc_bytes = 0;
+	clock_gettime(CLOCK_MONOTONIC, &r->t0);
+}
+
+void benchEnd(struct benchRun *r, long ops, const char *extra) //report, extra is more "key":value pairs or ""
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double ns = (t1.tv_sec - r->t0.tv_sec) * 1e9 + (t1.tv_nsec - r->t0.tv_nsec);
+	long allocs = bench_allocs;
+	size_t bytes = bench_alloc_bytes;
+	printf("{\"bench\":\"%s\",\"ops\":%ld,\"ns_per_op\":%.1f,\"total_ms\":%.3f,\"allocs\":%ld,\"alloc_bytes\":%zu,\"arena_allocs\":%ld,\"rows\":%d,\"peak_rss_kb\":%ld%s%s}\n",
+		r->name, ops, ops ? ns / ops : 0.0, ns / 1e6, allocs, bytes, E.arena.allocs - r->arena_allocs, E.numrows,
+		editorProcStatus("VmHWM:"), *extra ? "," : "", extra);
+	fflush(stdout);
+}
+
+unsigned int bench_seed = 1;
+
+unsigned int benchRand() //deterministic so runs compare
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return (bench_seed >> 16) & 0x7fff;
+}
+
+int benchCodeLine(char *buf, int i, int open) //one line of made up C, tabs, strings, comments, keywords and the odd utf-8 char. open = no */ anywhere
+{
+	static const char *lines[] = {
+		"\tint count_%d = %d; //running total",
+		"\tif (value_%d > %d && flags & 0x%x) return -1;",
+		"\tfor (int i = 0; i < %d; i++) buf[i] = 'x'; // %d",
+		"\tprintf(\"row %%d of %d: caf\xc3\xa9 \\\"quoted\\\"\\n\", %d);",
+		"/* block comment %d on one line, %d */",
+		"\t\tstruct erow *row_%d = &E.row[%d];",
+		"static double scale_%d = %d.25;",
+		"",
+		"}",
+		"void function_%d(char *s, size_t n) { //%d \xe2\x86\x92 arrow",
+	};
+	int k = benchRand() % (sizeof(lines) / sizeof(lines[0]));
+	if (open && k == 4) k = 0;
+	return sprintf(buf, lines[k], i, benchRand(), benchRand());
+}
+
+char *benchTempFile(const char *ext) //path of a fresh empty temp file, filetype comes from ext
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/kilo-bench-XXXXXX%s", ext);
+	int fd = mkstemps(path, strlen(ext));
+	if (fd == -1) die("mkstemps");
+	close(fd);
+	return strdup(path);
+}
+
+void benchWriteCode(const char *path, int lines, int open) //synthetic source file
+{
+	FILE *fp = fopen(path, "w");
+	char buf[256];
+	if (!fp) die("fopen");
+	for (int i = 0; i < lines; i++)
 	{
-		last_match = -1; 
-		direction = 1;
+		int n = benchCodeLine(buf, i, open);
+		buf[n++] = '\n';
+		fwrite(buf, 1, n, fp);
 	}
+	fclose(fp);
+}
 
-	if (last_match == -1) direction = 1; //reset direction to 1
-	int current = last_match; //set current match
-	int i; //loop counter
-	for (i = 0; i < E.numrows; i++) //iterate through rows
+void benchWriteLong(const char *path, int lines, int width) //a few very long lines
+{
+	FILE *fp = fopen(path, "w");
+	char buf[256];
+	if (!fp) die("fopen");
+	for (int i = 0; i < lines; i++)
 	{
-		current += direction; //go to next match
-		if (current == -1) current = E.numrows -1; //if last match go to first match
-		else if (current == E.numrows) current = 0; //if first match go to last match
-
-		erow *row = &E.row[current]; //temp row for internal use
-		char *match = strstr(row->render, query); //check row for matches and return string
-		if (match) //match found
+		for (int w = 0; w < width; )
 		{
-			last_match = current; //set last_match to curr
-			E.cy = current; //update cursor position to point to match
-			E.cx = editorRowRXtoCX(row, match - row->render); //convert rx to cx and move mouse to match
-			E.rowoff = E.numrows; //position match at top of editor
-			
-			saved_hl_line = current; //saving match line
-			saved_hl = malloc (row->rsize); //allocate 'render' space
-			memcpy(saved_hl, row->hl, row->rsize); //save original 'rendered' hl scheme
-			memset(&row->hl[E.cx], HL_MATCH, strlen(query)); //set match color to blue
-			break;
+			int n = benchCodeLine(buf, w, 0);
+			buf[n++] = ' ';
+			fwrite(buf, 1, n, fp);
+			w += n;
 		}
-
+		fputc('\n', fp);
 	}
+	fclose(fp);
+}
 
+void benchWriteFuncs(const char *path, int lines) //short functions with a comment over each, two folds per 8 lines
+{
+	FILE *fp = fopen(path, "w");
+	if (!fp) die("fopen");
+	for (int i = 0; i < lines / 8; i++)
+		fprintf(fp, "/* function_%d\n * returns \"}\" */\nchar *function_%d(int x) {\n\tif (x > %d) {\n\t\treturn \"}\";\n\t}\n\treturn \"{\";\n}\n", i, i, i);
+	fclose(fp);
 }
 
-void editorFind(){
-	int saved_cx = E.cx;
-	int saved_cy = E.cy;
-	int saved_coloff = E.coloff;
-	int saved_rowoff = E.rowoff;
+void benchWriteGzip(const char *from, const char *to) //gzip -c from > to
+{
+	FILE *fp = fopen(from, "r");
+	gzFile gz = gzopen(to, "wb");
+	char buf[1 << 16];
+	size_t n;
+	if (!fp || !gz) die("gzopen");
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) gzwrite(gz, buf, n);
+	fclose(fp);
+	gzclose(gz);
+}
 
-	char *query = editorPrompt("Search: %s (Use ESC/Arrows/Enter)", editorFindCallback);
-	if (query){
-		free(query);
-	} else {
-		E.cx = saved_cx;
-		E.cy = saved_cy;
-		E.coloff = saved_coloff;
-		E.rowoff = saved_rowoff;
+void benchOpen(const char *path) //fresh buffer from path, fully highlighted
+{
+	editorFreeRows();
+	editorOpen((char *)path);
+	editorHlFlush();
+}
+
+void benchType(const char *s, int len) //feed text in like keys, one undo group per key
+{
+	for (int i = 0; i < len; i++)
+	{
+		E.undo_group++;
+		if (s[i] == '\n') editorInsertNewline();
+		else editorInsertChar(s[i]);
 	}
 }
 
-#pragma endregion
+int benchWanted(int argc, char **argv, const char *name) //no names on the command line means run everything
+{
+	int any = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-') { i++; continue; } //-s N
+		any = 1;
+		if (!strcmp(argv[i], name)) return 1;
+	}
+	return !any;
+}
 
-#pragma region /*** input ***/
-char *editorPrompt(char *prompt, void(*callback)(char *, int)){
-	size_t bufsize = 128;
-	char *buf = malloc(bufsize);
+int main(int argc, char *argv[]){
+	int scale = 1;
+	for (int i = 1; i < argc - 1; i++)
+		if (!strcmp(argv[i], "-s")) scale = atoi(argv[i + 1]);
+	if (scale < 1)
+	{
+		fprintf(stderr, "usage: kilo-bench [-s SCALE] [BENCH...]\n");
+		return 1;
+	}
 
-	size_t buflen = 0;
-	buf[0] = '\0';
+	setenv("KILO_CACHE_DIR", "", 0); //no highlight cache unless asked for
+	initEditor(); //no terminal: default 80x24 screen, no worker thread, highlighting runs in editorHlFlush
+	pthread_mutex_lock(&E.lock);
+
+	int nlines = 200000 * scale;
+	char *code = benchTempFile(".c");
+	char *flat = benchTempFile(".c");
+	char *lng = benchTempFile(".c");
+	char *out = benchTempFile(".c");
+	benchWriteCode(code, nlines, 0);
+	benchWriteCode(flat, nlines, 1);
+	benchWriteLong(lng, 16, (1 << 20) * scale);
+
+	struct benchRun r;
+	char extra[128];
+	struct abuf ab = ABUF_INIT;
 
-	while (1) {
-		editorSetStatusMessage(prompt, buf);
-		editorRefreshScreen();
+	if (benchWanted(argc, argv, "open")) //split into rows only, highlighting is deferred
+	{
+		editorFreeRows();
+		benchStart(&r, "open");
+		editorOpen(code);
+		benchEnd(&r, E.numrows, "");
+		editorHlFlush();
+	}
 
-		int c = editorReadKey();
-		if (c == DELETE_KEY || c == CTRL_KEY('h') || c == BACKSPACE){
-			if (buflen != 0) buf [--buflen] = '\0';
-		} else if (c == '\x1b') {
-			editorSetStatusMessage("");
-			if (callback) callback(buf, c);
-			free(buf);
-			return NULL;
-		} else if (c == '\r'){
-			if(buflen != 0){
-				editorSetStatusMessage("");
-				if (callback) callback(buf, c);
-				return buf;
-			}
-		} else if (!iscntrl(c) && c < 128){
-			if(buflen == bufsize -1){
-				bufsize *= 2;
-				buf = realloc(buf, bufsize);
-			}
-			buf[buflen++] = c;
-			buf[buflen] = '\0';
-		}
-		if (callback) callback(buf, c);
+	if (benchWanted(argc, argv, "open_gz")) //the same file gzipped, inflated into rows. zcat_ms is zcat on it for scale
+	{
+		char *gz = benchTempFile(".c.gz"), cmd[128];
+		benchWriteGzip(code, gz);
+		struct stat st;
+		stat(code, &st);
+		snprintf(cmd, sizeof(cmd), "zcat %s > /dev/null", gz);
+		long t0 = editorProfNow();
+		int zcat = system(cmd);
+		double zcat_ms = (editorProfNow() - t0) / 1e6;
+		editorFreeRows();
+		benchStart(&r, "open_gz");
+		t0 = editorProfNow();
+		editorOpen(gz);
+		double ms = (editorProfNow() - t0) / 1e6;
+		snprintf(extra, sizeof(extra), "\"mb_per_s\":%.1f,\"zcat_ms\":%.3f", st.st_size / 1e3 / ms, zcat == 0 ? zcat_ms : -1.0);
+		benchEnd(&r, E.numrows, extra);
+		editorHlFlush();
+		unlink(gz);
+		free(gz);
 	}
-}
 
-void editorMoveCursor(int key){
-	erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+	if (benchWanted(argc, argv, "highlight")) //every row from scratch
+	{
+		editorFreeRows();
+		editorOpen(code);
+		benchStart(&r, "highlight");
+		editorHlFlush();
+		benchEnd(&r, E.numrows, "");
+	}
 
-	switch (key) {
-		case ARROW_UP:
-			if(E.cy > 0) E.cy--;
-			break;
+	if (benchWanted(argc, argv, "draw")) //page down through the file, one frame per page
+	{
+		benchOpen(code);
+		long frames = 0, bytes = 0;
+		benchStart(&r, "draw");
+		for (E.cy = 0; E.cy < E.numrows; E.cy += E.screenrows)
+		{
+			editorDrawFrame(&ab);
+			bytes += ab.len;
+			abFree(&ab);
+			ab = (struct abuf)ABUF_INIT;
+			frames++;
+		}
+		snprintf(extra, sizeof(extra), "\"bytes_per_op\":%.1f", frames ? (double)bytes / frames : 0.0);
+		benchEnd(&r, frames, extra);
+	}
 
-		case ARROW_DOWN:
-			if(E.cy < E.numrows) E.cy++;
-			break;
+	if (benchWanted(argc, argv, "find")) //next match over and over, wrapping around the file
+	{
+		benchOpen(code);
+		int finds = 2000 * scale;
+		editorFindCallback("scale_", 0);
+		benchStart(&r, "find");
+		for (int i = 0; i < finds; i++) editorFindCallback("scale_", ARROW_DOWN);
+		benchEnd(&r, finds, "");
+		editorFindCallback("scale_", '\r');
+	}
 
-		case ARROW_LEFT:
-			if(E.cx > 0){
-				E.cx--;
-			} else if (E.cy > 0){
-				E.cy --;
-				E.cx = E.row[E.cy].size;
-			}
-			E.farx = E.cx;
-			break;
-		
-		case ARROW_RIGHT:
-			if(row && E.cx < row->size){
-				E.cx++;
-				
-			} else if (E.cy < E.numrows){
-				E.cy ++;
-				E.cx = 0;
-			}
-			E.farx = E.cx;
-			break;
+	if (benchWanted(argc, argv, "type")) //keys into the middle of the file, a newline every line's worth
+	{
+		benchOpen(code);
+		int keys = 100000 * scale;
+		char buf[256];
+		E.cy = E.numrows / 2;
+		benchStart(&r, "type");
+		for (int done = 0; done < keys; )
+		{
+			int n = benchCodeLine(buf, done, 0);
+			buf[n++] = '\n';
+			if (n > keys - done) n = keys - done;
+			benchType(buf, n);
+			done += n;
+		}
+		benchEnd(&r, keys, "");
 	}
-	row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-	int rowlen = row ? row->size : 0;	
-	E.cx = (E.farx < rowlen) ? E.farx : rowlen;
 
-}
+	if (benchWanted(argc, argv, "paste")) //64K of code arriving as keys at the top, then highlight what it pushed down
+	{
+		benchOpen(code);
+		int len = (64 << 10) * scale, n = 0;
+		char *buf = malloc(len + 256);
+		while (n < len)
+		{
+			n += benchCodeLine(buf + n, n, 0);
+			buf[n++] = '\n';
+		}
+		benchStart(&r, "paste");
+		benchType(buf, n);
+		editorHlFlush();
+		benchEnd(&r, n, "");
+
+		benchStart(&r, "undo_paste");
+		while (E.undolen) editorUndo(); //one group per key
+		editorHlFlush();
+		benchEnd(&r, n, "");
+		free(buf);
+	}
 
-void editorProcessKeypress(){
-	//maintain count across calls
-	static int quit_times = KILO_QUIT_TIMES;
+	if (benchWanted(argc, argv, "comment_cascade")) //open and close a comment on line 1 of a file with no */, every row below flips
+	{
+		benchOpen(flat);
+		int toggles = 4;
+		benchStart(&r, "comment_cascade");
+		for (int i = 0; i < toggles; i++)
+		{
+			E.cx = E.cy = 0;
+			benchType("/*", 2);
+			editorHlFlush();
+			E.cx = 2;
+			editorBackspace();
+			editorBackspace();
+			editorHlFlush();
+		}
+		benchEnd(&r, (long)toggles * 2 * E.numrows, ""); //ops = rows rehighlighted
+	}
 
-	//get c from editor
-	int c = editorReadKey();
-	
-	//if c is a hotkey, apply case behavior
-	switch (c) {
-		case '\r':
-			editorInsertNewline();
-			break;
+	if (benchWanted(argc, argv, "long_lines")) //typing, moving and drawing in the middle of 1MB lines
+	{
+		editorFreeRows();
+		benchStart(&r, "long_lines_open");
+		editorOpen(lng);
+		editorHlFlush();
+		benchEnd(&r, E.numrows, "");
+
+		int keys = 1000;
+		E.cy = E.numrows / 2;
+		E.cx = E.row[E.cy].size / 2;
+		benchStart(&r, "long_lines_type");
+		for (int i = 0; i < keys; i++)
+		{
+			E.undo_group++;
+			editorInsertChar('a' + i % 26);
+		}
+		editorHlFlush();
+		benchEnd(&r, keys, "");
 
-		case CTRL_KEY('s'):
-			editorSave();
-			break;
+		benchStart(&r, "long_lines_move");
+		for (int i = 0; i < keys; i++) editorMoveCursor(i % 2 ? ARROW_UP : ARROW_DOWN);
+		benchEnd(&r, keys, "");
 
-		case CTRL_KEY('q'):
-			if (E.dirty && quit_times > 0) {
-				editorSetStatusMessage("WARNING!!! File has unsaved changes." "Press Ctrl-Q %d more times to quit", quit_times);
-				quit_times--;
-				return;
+		int frames = 2000;
+		long bytes = 0;
+		benchStart(&r, "long_lines_draw");
+		for (int i = 0; i < frames; i++)
+		{
+			for (int k = 0; k < 37; k++) editorMoveCursor(ARROW_RIGHT);
+			editorDrawFrame(&ab);
+			bytes += ab.len;
+			abFree(&ab);
+			ab = (struct abuf)ABUF_INIT;
+		}
+		snprintf(extra, sizeof(extra), "\"bytes_per_op\":%.1f", (double)bytes / frames);
+		benchEnd(&r, frames, extra);
+	}
+
+	if (benchWanted(argc, argv, "wrap")) //soft wrap: page down through the code and the 1MB lines, then type with a frame per key
+	{
+		benchOpen(code);
+		benchStart(&r, "wrap_on");
+		editorWrapToggle();
+		editorScroll(); //counts every row
+		benchEnd(&r, E.numrows, "");
+
+		long frames = 0;
+		benchStart(&r, "wrap_page");
+		for (E.cy = E.cx = 0; E.cy < E.numrows; frames++)
+		{
+			editorMoveCursor(PAGE_DOWN);
+			editorDrawFrame(&ab);
+			abFree(&ab);
+			ab = (struct abuf)ABUF_INIT;
+		}
+		benchEnd(&r, frames, "");
+
+		int keys = 10000;
+		char buf[256];
+		E.cy = E.numrows / 2;
+		E.cx = 0;
+		benchStart(&r, "wrap_type"); //a newline every line's worth, each one shifts the counts below
+		for (int done = 0; done < keys; )
+		{
+			int n = benchCodeLine(buf, done, 0);
+			buf[n++] = '\n';
+			if (n > keys - done) n = keys - done;
+			for (int i = 0; i < n; i++)
+			{
+				benchType(&buf[i], 1);
+				editorDrawFrame(&ab);
+				abFree(&ab);
+				ab = (struct abuf)ABUF_INIT;
 			}
-			clearScreen();
-			exit(0);
-			break;
+			done += n;
+		}
+		editorHlFlush();
+		benchEnd(&r, keys, "");
 
-		case HOME_KEY:
-			E.cx = 0;
-			E.farx = E.cx;
-			break;
-		case END_KEY:
-			E.cx = (E.cy < E.numrows) ? E.row[E.cy].size : E.cx;
-			E.farx = E.cx;
-			break;
-			
-		case CTRL_KEY('f'):
-			editorFind();
-			break;
+		benchOpen(lng);
+		frames = 0;
+		benchStart(&r, "wrap_long_page");
+		for (E.cy = E.cx = 0; E.cy < E.numrows && frames < 2000; frames++)
+		{
+			editorMoveCursor(PAGE_DOWN);
+			editorDrawFrame(&ab);
+			abFree(&ab);
+			ab = (struct abuf)ABUF_INIT;
+		}
+		benchEnd(&r, frames, "");
+		editorWrapToggle(); //off for whatever runs next
+	}
 
-		case BACKSPACE:
-		case CTRL_KEY('h'):
-			if (E.cx != 0 || E.cy != 0){
-					int startx = E.cx;
-					editorMoveCursor(ARROW_LEFT);
-					editorDelChar();
-					if (startx > 1){
-						editorMoveCursor(ARROW_RIGHT);
-					} 
-					
-				} 
-				break;
-		case DELETE_KEY:
-			editorDelChar();
-			break;
-			
-			
-		
-		case PAGE_UP:
-		case PAGE_DOWN:
+	if (benchWanted(argc, argv, "fold")) //close every block of a file of short functions, page through it, then type under it with a frame per key
+	{
+		char *fns = benchTempFile(".c");
+		benchWriteFuncs(fns, nlines);
+		benchOpen(fns);
+		benchStart(&r, "fold_all");
+		editorFoldAll();
+		snprintf(extra, sizeof(extra), "\"folds\":%d", E.fold.n);
+		benchEnd(&r, E.numrows, extra);
+
+		long frames = 0;
+		benchStart(&r, "fold_page");
+		for (E.cy = E.cx = 0; E.cy < E.numrows; frames++)
+		{
+			editorMoveCursor(PAGE_DOWN);
+			editorDrawFrame(&ab);
+			abFree(&ab);
+			ab = (struct abuf)ABUF_INIT;
+		}
+		benchEnd(&r, frames, "");
+
+		int keys = 10000;
+		char buf[256];
+		E.cy = E.numrows;
+		E.cx = 0;
+		benchStart(&r, "fold_type"); //every new row moves the folds
+		for (int done = 0; done < keys; )
+		{
+			int n = benchCodeLine(buf, done, 0);
+			buf[n++] = '\n';
+			if (n > keys - done) n = keys - done;
+			for (int i = 0; i < n; i++)
 			{
-				if (c == PAGE_UP){
-					E.cy = E.rowoff;
-				} else if (c == PAGE_DOWN){
-					E.cy = E.rowoff + E.screenrows - 1;
-				}
+				benchType(&buf[i], 1);
+				editorDrawFrame(&ab);
+				abFree(&ab);
+				ab = (struct abuf)ABUF_INIT;
+			}
+			done += n;
+		}
+		editorHlFlush();
+		benchEnd(&r, keys, "");
+		editorFoldAll(); //open for whatever runs next
+		unlink(fns);
+		free(fns);
+	}
 
-				int times = E.screenrows;
-				while (times--){
-					editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+	if (benchWanted(argc, argv, "bracket")) //index the code's brackets, find partners all over it, then type with the pair looked up every frame
+	{
+		benchOpen(code);
+		benchStart(&r, "bracket_build");
+		editorBracketSync();
+		benchEnd(&r, E.numrows, "");
+
+		long n = 0, found = 0, away = 0;
+		benchStart(&r, "bracket_match"); //the first bracket of every 7th row
+		for (int i = 0; i < E.numrows; i += 7)
+		{
+			erowdraw *row = &E.rowdraw[i];
+			hlspan *sp = row->hl;
+			for (int j = 0; j < row->rsize; j++)
+			{
+				int mrow, mri;
+				if (editorBracketKind(row->render[j]) < 0 || editorBracketSkip(row, &sp, j)) continue;
+				n++;
+				if (editorBracketMatch(i, j, &mrow, &mri))
+				{
+					found++;
+					away += mrow > i ? mrow - i : i - mrow;
 				}
+				break;
+			}
+		}
+		snprintf(extra, sizeof(extra), "\"found\":%ld,\"rows_away\":%.0f", found, found ? (double)away / found : 0.0);
+		benchEnd(&r, n, extra);
+
+		int keys = 10000;
+		char buf[256];
+		E.cy = E.numrows / 2;
+		E.cx = 0;
+		benchStart(&r, "bracket_type"); //every new row moves the leaves below it
+		for (int done = 0; done < keys; )
+		{
+			int len = benchCodeLine(buf, done, 0);
+			buf[len++] = '\n';
+			if (len > keys - done) len = keys - done;
+			for (int i = 0; i < len; i++)
+			{
+				benchType(&buf[i], 1);
+				editorDrawFrame(&ab);
+				abFree(&ab);
+				ab = (struct abuf)ABUF_INIT;
 			}
-			break;	
+			done += len;
+		}
+		editorHlFlush();
+		benchEnd(&r, keys, "");
 
-		case ARROW_UP:
-		case ARROW_DOWN:
-		case ARROW_LEFT:
-		case ARROW_RIGHT:
-			editorMoveCursor(c);	
-			break;
+		benchStart(&r, "bracket_jump_type"); //each line 64 rows up or down from the last, the gap follows
+		for (int done = 0, line = 0; done < keys; line++)
+		{
+			E.cy += line % 2 ? 64 : -64;
+			E.cx = 0;
+			int len = benchCodeLine(buf, done, 0);
+			buf[len++] = '\n';
+			if (len > keys - done) len = keys - done;
+			for (int i = 0; i < len; i++)
+			{
+				benchType(&buf[i], 1);
+				editorDrawFrame(&ab);
+				abFree(&ab);
+				ab = (struct abuf)ABUF_INIT;
+			}
+			done += len;
+		}
+		editorHlFlush();
+		benchEnd(&r, keys, "");
+	}
 
-		case CTRL_KEY('l'):
-		case '\x1b':
-			break;
-		
-		default:
-			editorInsertChar(c);
-			break;
+	if (benchWanted(argc, argv, "save")) //write the whole buffer out
+	{
+		benchOpen(code);
+		free(E.filename);
+		E.filename = strdup(out);
+		E.dirty = 1;
+		long len = 0;
+		for (int i = 0; i < E.numrows; i++) len += E.row[i].size + 1;
+		benchStart(&r, "save");
+		editorSave();
+		benchEnd(&r, len, ""); //ops = bytes
 	}
 
-	quit_times = KILO_QUIT_TIMES;
+	abFree(&ab);
+	unlink(code);
+	unlink(flat);
+	unlink(lng);
+	unlink(out);
+	return 0;
 }
-#pragma endregion
 
-/*** Initialization ***/
-void initEditor(){
-	//init editor to def state
-	E.cx = 0;
-	E.cy = 0;
-	E.rx = 0;
-
-	//offset init
-	E.numrows = 0;
-	E.rowoff = 0;
-	E.coloff = 0;
-	E.row = NULL;
+#endif
 
-	//file status
-	E.dirty = 0;
+#pragma endregion
 
-	//status bar
-	E.filename = NULL;
-	E.statusmsg[0] = '\0';
-	E.statusmsg_time = 0;
+#ifndef KILO_BENCH
 
-	//syntax settings
-	E.syntax = NULL;
+int main(int argc, char *argv[]){
+	if (argc >= 3 && !strcmp(argv[1], "--replay")) return editorReplayMain(argc, argv);
+	if (argc >= 2 && !strcmp(argv[1], "--server")) return editorServerMain(argc, argv);
+	if (argc >= 2 && !strcmp(argv[1], "--client")) return editorClientMain(argc, argv);
 
-	if (getWindowSize(&E.screenrows, &E.screencols) == -1) die("getWindowSize");
-	E.screenrows -= 2;
-}
+	//keep a copy of every key for --replay
+	char *record = NULL;
+	if (argc >= 3 && !strcmp(argv[1], "--record"))
+	{
+		record = argv[2];
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
 
-int main(int argc, char *argv[]){
 	//enable editor mode
-	enableRawMode();
 	initEditor();
+	int stream = -1; //kilo -, which buffer reads stdin
+	for (int i = 1; i < argc && !(argc >= 2 && !strcmp(argv[1], "--grep")); i++) if (!strcmp(argv[i], "-") && stream == -1) stream = i - 1;
+	if (stream != -1) editorStreamTty();
+	if (record && (E.record_fd = open(record, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) die("record");
+	enableRawMode();
+	if (getWindowSize(&E.termrows, &E.termcols) == -1) die("getWindowSize");
+	E.screenrows = E.termrows - 2;
+	E.screencols = E.termcols;
+	editorProfStart();
+	editorMemStart();
+	editorHlStart();
 
 	//Checking for filename argument. no error handling yet
-	if (argc >= 2){
-		editorOpen(argv[1]);
+	if (argc >= 2 && !strcmp(argv[1], "--grep")){
+		if (argc < 4)
+		{
+			clearScreen();
+			fprintf(stderr, "usage: kilo --grep PATTERN DIR\n");
+			exit(1);
+		}
+		editorBuffersInit(NULL, 0);
+		editorGrep(argv[2], argv[3]);
+	} else {
+		editorBuffersInit(argv + 1, argc - 1); //one buffer per file, only the first is read now
+		if (stream != -1) editorStreamStart(stream);
 	}
 	
 	//status message
-	//editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
+	//editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-R/E = replace/regex | Ctrl-Z = undo");
 
 	//go till break
 	while(1) {
@@ -1300,3 +8018,4 @@ int main(int argc, char *argv[]){
 	return 0;
 }
 
+#endif